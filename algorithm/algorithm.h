@@ -1,15 +1,51 @@
 #ifndef ALGORITHM_H
 #define ALGORITHM_H
 
+#include <cstddef>
+#include <utility>
+#include <memory>
+#include <iterator>
+#include <vector>
+#include <type_traits>
+
+// ALGO_PREFETCH(p) hints the processor to load the cache line holding
+// address p, on compilers which tell how, and does nothing elsewhere
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define ALGO_PREFETCH(p) _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define ALGO_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define ALGO_PREFETCH(p) ((void)(p))
+#endif
+
+// small_sort() has AVX2 sorting networks on x86, see small_sort.h
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define ALGO_SORTING_NETWORKS 1
+#else
+#define ALGO_SORTING_NETWORKS 0
+#endif
+
 namespace algo
 {
-    template<typename T>
-    void swap(T& t1, T& t2)
+    namespace _adl
+    {
+        using std::swap;
+
+        template<typename T>
+        void _swap(T& t1, T& t2)
+        {
+            swap(t1, t2);
+        }
+    }
+
+    // Swaps by the swap() found for T by argument-dependent lookup, or by
+    // std::swap, which moves. Of two parameter types, so that for types of
+    // this namespace the lookup prefers those over this one.
+    template<typename T, typename U>
+    void swap(T& t1, U& t2)
     {
-        // trivial swap
-        T tmp(t1);
-        t1 = t2;
-        t2 = tmp;
+        _adl::_swap(t1, t2);
     }
 
     template<typename T>
@@ -28,45 +64,271 @@ namespace algo
         }
     };
 
-    // Sorts elements in range [first, last) into ascending order.
-    // pred: predicator that defines a strict weak ordering
+    // Sorts short ranges by insertion, greater elements are moved up one by
+    // one to make room
     template<
         typename RandomAccessIterator,
         typename Predicator>
-    void quick_sort(RandomAccessIterator first,
-                    RandomAccessIterator last,
-                    Predicator           pred)
+    void _insertion_sort(RandomAccessIterator first,
+                         RandomAccessIterator last,
+                         Predicator           pred)
     {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+
         if( last - first < 2 )
         {
-            // No need to take any action
             return;
         }
 
-        // partition - divide and conquer
+        for(RandomAccessIterator i = first + 1; i < last; ++i)
+        {
+            if( !pred(*i, *(i-1)) )
+            {
+                continue;
+            }
+
+            value_type t = std::move(*i);
+            RandomAccessIterator j = i;
+            do
+            {
+                *j = std::move(*(j-1));
+                --j;
+            } while( j != first && pred(t, *(j-1)) );
+            *j = std::move(t);
+        }
+    }
+
+    enum { small_sort_max = 64 }; // longest range sorted by sorting networks
+
+    // Sorts elements in range [first, last) into ascending order. Ranges of
+    // up to small_sort_max elements are sorted by sorting networks in AVX2
+    // registers if the processor has them, by insertion otherwise, longer
+    // ranges by quick_sort. Defined in small_sort.h.
+    inline void small_sort(int*       first, int*       last);
+    inline void small_sort(long long* first, long long* last);
+    inline void small_sort(float*     first, float*     last);
+    inline void small_sort(double*    first, double*    last);
+
+    // Whether small_sort() has sorting networks for ranges of
+    // RandomAccessIterator ordered by Predicator: contiguous ranges of int,
+    // long long, float or double in ascending order. Networks do not keep
+    // equal elements in order, which is only noticed for floating point ones.
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    class _small_sort_kernel
+    {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+
+    public:
+        enum
+        {
+            value = ALGO_SORTING_NETWORKS                       &&
+                    (std::is_same<value_type, int>::value       ||
+                     std::is_same<value_type, long long>::value ||
+                     std::is_same<value_type, float>::value     ||
+                     std::is_same<value_type, double>::value)   &&
+                    std::is_same<Predicator, algo::less<value_type> >::value &&
+                    (std::is_pointer<RandomAccessIterator>::value ||
+                     std::is_same<RandomAccessIterator, typename std::vector<value_type>::iterator>::value),
+            stable = value && std::is_integral<value_type>::value
+        };
+    };
+
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void _small_sort(RandomAccessIterator first,
+                     RandomAccessIterator last,
+                     Predicator           pred,
+                     std::false_type)
+    {
+        algo::_insertion_sort(first, last, pred);
+    }
+
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void _small_sort(RandomAccessIterator first,
+                     RandomAccessIterator last,
+                     Predicator           /*pred*/,
+                     std::true_type)
+    {
+        if( last - first > 1 )
+        {
+            algo::small_sort(&*first, &*first + (last - first));
+        }
+    }
+
+    // Puts the median of *a, *b and *c in *b, the least in *a
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void _sort3(RandomAccessIterator a,
+                RandomAccessIterator b,
+                RandomAccessIterator c,
+                Predicator           pred)
+    {
+        if( pred(*b, *a) ){ algo::swap(*a, *b); }
+        if( pred(*c, *b) )
+        {
+            algo::swap(*b, *c);
+            if( pred(*b, *a) ){ algo::swap(*a, *b); }
+        }
+    }
+
+    // Moves the pivot to *first: median of the first, middle and last
+    // elements, or the median of three such medians (ninther) for long ranges.
+    // An element not less than the pivot is left at the end.
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void _quick_sort_pivot(RandomAccessIterator first,
+                           RandomAccessIterator last,
+                           Predicator           pred)
+    {
+        RandomAccessIterator mid = first + (last - first) / 2;
+        algo::_sort3(first, mid, last - 1, pred);
+        if( last - first > 128 )
+        {
+            algo::_sort3(first + 1, mid - 1, last - 2, pred);
+            algo::_sort3(first + 2, mid + 1, last - 3, pred);
+            algo::_sort3(mid - 1, mid, mid + 1, pred);
+        }
+        algo::swap(*first, *mid);
+    }
+
+    // Partitions [first, last) around the pivot *first, returns the final
+    // position of the pivot. Elements equal to the pivot stop both scans, so
+    // they spread over both sides.
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    RandomAccessIterator _quick_sort_partition(RandomAccessIterator first,
+                                               RandomAccessIterator last,
+                                               Predicator           pred)
+    {
+        RandomAccessIterator left = first, right = last;
+        for(;;)
+        {
+            // the element at the end, and the pivot, stop the scans
+            while( pred(*++left, *first)  ){}
+            while( pred(*first, *--right) ){}
+            if( !(left < right) )
+            {
+                break;
+            }
+            algo::swap(*left, *right);
+        }
+        algo::swap(*first, *right);
+        return right;
+    }
+
+    // Partitions [first, last) into elements not greater than the pivot *first
+    // and elements greater than it, returns the final position of the pivot
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    RandomAccessIterator _quick_sort_partition_equal(RandomAccessIterator first,
+                                                     RandomAccessIterator last,
+                                                     Predicator           pred)
+    {
         RandomAccessIterator left = first, right = last;
-        for(++left, --right; left < right; )
+        while( pred(*first, *--right) ){}
+        while( left < right && !pred(*first, *++left) ){}
+        while( left < right )
+        {
+            algo::swap(*left, *right);
+            while( pred(*first, *--right) ){}
+            while( !pred(*first, *++left) ){}
+        }
+        algo::swap(*first, *right);
+        return right;
+    }
+
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void heap_sort(RandomAccessIterator first,
+                   RandomAccessIterator last,
+                   Predicator           pred);
+
+    // Introsort loop, loops on the larger part and recurses on the smaller
+    // one, so that the stack depth stays within log2(n). Switches to
+    // heap_sort once depth partitions went by. A range that is not leftmost
+    // is preceded by a pivot not greater than any of its elements.
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void _quick_sort_loop(RandomAccessIterator first,
+                          RandomAccessIterator last,
+                          size_t               depth,
+                          bool                 leftmost,
+                          Predicator           pred)
+    {
+        // ranges up to this long are sorted by _small_sort(), sorting
+        // networks handle longer ones than insertion does
+        enum { cutoff = _small_sort_kernel<RandomAccessIterator, Predicator>::value ? 32 : 16 };
+
+        while( last - first > cutoff )
         {
-            while( left < right && pred(*left, *first)   ){ ++left;  }  // here we got *left >= *pivot
-            while( left < right && !pred(*right, *first) ){ --right; }  // here we got *right < *pivot
+            if( !depth-- )
+            {
+                algo::heap_sort(first, last, pred);
+                return;
+            }
+
+            algo::_quick_sort_pivot(first, last, pred);
+
+            // The pivot equals the preceding one, so do all elements not
+            // greater than it. Split them off, they are in place.
+            if( !leftmost && !pred(*(first-1), *first) )
+            {
+                first = algo::_quick_sort_partition_equal(first, last, pred) + 1;
+                continue;
+            }
 
-            if( left < right )
+            RandomAccessIterator mid = algo::_quick_sort_partition(first, last, pred);
+            if( mid - first < last - mid )
+            {
+                algo::_quick_sort_loop(first, mid, depth, leftmost, pred);
+                first    = mid + 1;
+                leftmost = false;
+            }
+            else
             {
-                algo::swap(*left, *right);
-                ++left;
-                --right;
+                algo::_quick_sort_loop(mid + 1, last, depth, false, pred);
+                last = mid;
             }
         }
+        typedef std::integral_constant<bool, _small_sort_kernel<RandomAccessIterator, Predicator>::value> kernel;
+        algo::_small_sort(first, last, pred, kernel());
+    }
 
-        // Move pivot element to its position
-        if( !pred(*first, *right) )
+    // Sorts elements in range [first, last) into ascending order.
+    // pred: predicator that defines a strict weak ordering
+    // Introsort: quick sort pivoting on medians, falling back to heap sort
+    // after 2*log2(n) levels, which bounds the worst case to O(n log n).
+    // Runs of keys equal to a pivot are split off in a single pass.
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void quick_sort(RandomAccessIterator first,
+                    RandomAccessIterator last,
+                    Predicator           pred)
+    {
+        if( last - first < 2 )
         {
-            algo::swap(*first, *right);
+            // No need to take any action
+            return;
         }
 
-        // At the end of loop, we got left >= right and distance(left, right) <= 1
-        algo::quick_sort(first, right, pred);
-        algo::quick_sort(left, last, pred);
+        size_t depth = 0;
+        for(size_t n = last - first; n > 1; n /= 2)
+        {
+            depth += 2;
+        }
+        algo::_quick_sort_loop(first, last, depth, true, pred);
     }
     
     template<typename RandomAccessIterator>
@@ -78,30 +340,37 @@ namespace algo
             return;
         }
 
-        // partition - divide and conquer
-        RandomAccessIterator left = first, right = last;
-        for(++left, --right; left < right; )
-        {
-            while( left < right && *left < *first     ){ ++left;  }  // here we got *left >= *pivot
-            while( left < right && !(*right < *first) ){ --right; }  // here we got *right < *pivot
-
-            if( left < right )
-            {
-                algo::swap(*left, *right);
-                ++left;
-                --right;
-            }
-        }
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+        algo::quick_sort(first, last, algo::less<value_type>());
+    }
 
-        // At the end of loop, we got left >= right and distance(left, right) <= 1
-        // Compare pivot element with the element at partition boundary
-        if( !(*first < *right) )
+    // Sorts elements in range [first, last) into ascending order, meant for
+    // short ranges. Ranges small_sort() has sorting networks for are passed
+    // on to them, other ones of up to small_sort_max elements are insertion
+    // sorted, longer ones quick sorted.
+    // pred: predicator that defines a strict weak ordering
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void small_sort(RandomAccessIterator first,
+                    RandomAccessIterator last,
+                    Predicator           pred)
+    {
+        if( last - first > small_sort_max )
         {
-            algo::swap(*first, *right);
+            algo::quick_sort(first, last, pred);
+            return;
         }
 
-        algo::quick_sort(first, right);
-        algo::quick_sort(left, last);
+        typedef std::integral_constant<bool, _small_sort_kernel<RandomAccessIterator, Predicator>::value> kernel;
+        algo::_small_sort(first, last, pred, kernel());
+    }
+
+    template<typename RandomAccessIterator>
+    void small_sort(RandomAccessIterator first, RandomAccessIterator last)
+    {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+        algo::small_sort(first, last, algo::less<value_type>());
     }
 
     template<
@@ -297,70 +566,345 @@ namespace algo
         }
     }
 
-    // Sorts elements in range [first, last) into ascending order.
-    // buffer: Buffer to be used by the sorting procedure. Size of buffer should
-    //  be at least number of elements in [first, last), i.e. last-first
-    // pred:   predicator that defines a strict weak ordering
-    template<typename RandomAccessIterator>
-    void merge_sort(RandomAccessIterator first, RandomAccessIterator last,
-                    RandomAccessIterator buffer)
+    // Same as merge(), moves the elements instead of copying them
+    template<
+        typename InputIterator,
+        typename OutputIterator,
+        typename Predicator>
+    void move_merge(InputIterator  first1, InputIterator last1,
+                    InputIterator  first2, InputIterator last2,
+                    OutputIterator result, Predicator    pred)
     {
-        size_t count = last - first;
-        if( last < first || count <= 1 )
+        while( first1 != last1 && first2 != last2 )
         {
-            return;
+            if( pred(*first2, *first1) )
+            {
+                *result = std::move(*first2);
+                ++first2;
+            }
+            else
+            {
+                *result = std::move(*first1);
+                ++first1;
+            }
+            ++result;
+        }
+
+        for(; first1 != last1; ++first1, ++result)
+        {
+            *result = std::move(*first1);
         }
 
-        // divide and conquer
-        size_t half = count / 2;
-        algo::merge_sort(first, first + half, buffer);
-        algo::merge_sort(first + half, last, buffer + half);
-        
-        // merge subrange into buffer
-        algo::merge(first, first+half, first+half, first+count, buffer);
+        for(; first2 != last2; ++first2, ++result)
+        {
+            *result = std::move(*first2);
+        }
+    }
 
-        // in-place output, copy ordered elements from buffer to [first, last)
-        algo::merge(buffer, buffer+count, last, last, first);
+    template<
+        typename InputIterator,
+        typename OutputIterator>
+    void move_merge(InputIterator  first1, InputIterator last1,
+                    InputIterator  first2, InputIterator last2,
+                    OutputIterator result)
+    {
+        typedef typename std::iterator_traits<InputIterator>::value_type value_type;
+        algo::move_merge(first1, last1, first2, last2, result, algo::less<value_type>());
     }
 
-    // Search for element within the ordered range [first, last)
-    // pred: predicator that defines a strict weak ordering
-    // Returns true if the specified element is found.
+    // Length of the prefix of the count elements from first that satisfy
+    // in_prefix, found by steps of doubling length from first and a binary
+    // search of the last step. Takes O(log n) tests for a prefix of n.
     template<
         typename RandomAccessIterator,
-        typename Element,
+        typename Test>
+    size_t _gallop(RandomAccessIterator first, size_t count, Test in_prefix)
+    {
+        size_t lo = 0, step = 1;
+        while( lo + step <= count && in_prefix(*(first + (lo + step - 1))) )
+        {
+            lo  += step;
+            step *= 2;
+        }
+
+        size_t hi = lo + step <= count ? lo + step - 1 : count;
+        while( lo < hi )
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if( in_prefix(*(first + mid)) )
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // Same as move_merge(). Once a run has supplied gallop elements in a row,
+    // the stretch of it that goes next is found by _gallop() and moved as a
+    // whole, so runs with little interleaving merge in fewer comparisons.
+    template<
+        typename InputIterator,
+        typename OutputIterator,
         typename Predicator>
-    bool binary_search(RandomAccessIterator first,
-                       RandomAccessIterator last,
-                       const Element&       element,
-                       Predicator           pred)
+    void _gallop_merge(InputIterator  first1, InputIterator last1,
+                       InputIterator  first2, InputIterator last2,
+                       OutputIterator result, Predicator    pred)
     {
-        while( first < last )
+        typedef typename std::iterator_traits<InputIterator>::value_type value_type;
+        enum { gallop = 7 };
+
+        // the last element of the first run does not go after the first of
+        // the second, the runs are in order already
+        bool ordered = first1 == last1 || first2 == last2 || !pred(*first2, *(last1-1));
+        size_t wins1 = 0, wins2 = 0;
+        while( !ordered && first1 != last1 && first2 != last2 )
         {
-            RandomAccessIterator center = first + (last-first)/2;
-            if( pred(*center, element) )
+            if( wins1 >= gallop )
+            {
+                const value_type& v = *first2;
+                size_t n = algo::_gallop(first1, last1 - first1, [&](const value_type& e) { return !pred(v, e); });
+                for(; n; --n, ++first1, ++result)
+                {
+                    *result = std::move(*first1);
+                }
+                wins1 = 0;
+            }
+            else if( wins2 >= gallop )
+            {
+                const value_type& v = *first1;
+                size_t n = algo::_gallop(first2, last2 - first2, [&](const value_type& e) { return pred(e, v); });
+                for(; n; --n, ++first2, ++result)
+                {
+                    *result = std::move(*first2);
+                }
+                wins2 = 0;
+            }
+            else if( pred(*first2, *first1) )
             {
-                first = center + 1; // target element may fall in [center+1, last)
+                *result = std::move(*first2);
+                ++first2;
+                ++result;
+                ++wins2;
+                wins1 = 0;
             }
-            else if( pred(element, *center) )
+            else
             {
-                last = center;      // target element may fall in [first, center)
+                *result = std::move(*first1);
+                ++first1;
+                ++result;
+                ++wins1;
+                wins2 = 0;
             }
-            else return true;       // found it
         }
-        return false;
+
+        for(; first1 != last1; ++first1, ++result)
+        {
+            *result = std::move(*first1);
+        }
+
+        for(; first2 != last2; ++first2, ++result)
+        {
+            *result = std::move(*first2);
+        }
+    }
+
+    // Shortest run of merge_sort, between 32 and 64, such that count divided
+    // by it is a power of 2 or slightly less, so merge passes stay balanced
+    inline size_t _merge_sort_min_run(size_t count)
+    {
+        size_t odd = 0;
+        while( count >= 64 )
+        {
+            odd |= count & 1;
+            count >>= 1;
+        }
+        return count + odd;
     }
 
+    // Length of the run at the start of [first, last): the elements in
+    // ascending order, or in strictly descending order, which are reversed.
+    // Runs shorter than min_run are extended and sorted by _small_sort().
     template<
         typename RandomAccessIterator,
-        typename Element>
-    bool binary_search(RandomAccessIterator first,
-                       RandomAccessIterator last,
-                       const Element&       element)
+        typename Predicator>
+    size_t _merge_sort_run(RandomAccessIterator first,
+                           RandomAccessIterator last,
+                           size_t               min_run,
+                           Predicator           pred)
     {
-        return algo::binary_search(first, last, element, algo::less<Element>());
+        size_t count = last - first;
+        size_t n = count < 2 ? count : 2;
+        if( n == 2 && pred(*(first+1), *first) )
+        {
+            // strictly, to keep equal elements in order
+            while( n < count && pred(*(first+n), *(first+n-1)) )
+            {
+                ++n;
+            }
+            for(size_t i = 0, j = n - 1; i < j; ++i, --j)
+            {
+                algo::swap(*(first+i), *(first+j));
+            }
+        }
+        else
+        {
+            while( n < count && !pred(*(first+n), *(first+n-1)) )
+            {
+                ++n;
+            }
+        }
+
+        if( n < min_run )
+        {
+            // sorting networks for integers only, they move equal elements
+            n = min_run < count ? min_run : count;
+            typedef std::integral_constant<bool, _small_sort_kernel<RandomAccessIterator, Predicator>::stable> kernel;
+            algo::_small_sort(first, first + n, pred, kernel());
+        }
+        return n;
+    }
+
+    // Merges neighbouring pairs of the runs of src delimited by bounds into
+    // the same positions of dst, a last run without a partner is moved.
+    // bounds is updated to delimit the merged runs.
+    template<
+        typename InputIterator,
+        typename OutputIterator,
+        typename Predicator>
+    void _merge_sort_pass(InputIterator        src,
+                          OutputIterator       dst,
+                          std::vector<size_t>& bounds,
+                          Predicator           pred)
+    {
+        size_t runs = bounds.size() - 1;
+        size_t kept = 0;
+        for(size_t i = 0; i < runs; i += 2)
+        {
+            size_t lo  = bounds[i];
+            size_t mid = bounds[i+1];
+            size_t hi  = i + 2 <= runs ? bounds[i+2] : mid;
+            algo::_gallop_merge(src + lo, src + mid, src + mid, src + hi, dst + lo, pred);
+            bounds[kept++] = lo;
+        }
+        bounds[kept++] = bounds[runs];
+        bounds.resize(kept);
+    }
+
+    // Sorts elements in range [first, last) into ascending order, stable.
+    // buffer: Buffer to be used by the sorting procedure. Size of buffer should
+    //  be at least number of elements in [first, last), i.e. last-first
+    // pred:   predicator that defines a strict weak ordering
+    // Bottom-up: the range is cut into the runs it is made of, short runs are
+    // extended by insertion sort, then every pass merges pairs of runs from
+    // the range into the buffer or back. Sorted input takes a single scan,
+    // input of few runs takes few passes. Elements are moved, never copied.
+    template<
+        typename RandomAccessIterator,
+        typename BufferIterator,
+        typename Predicator>
+    void merge_sort(RandomAccessIterator first, RandomAccessIterator last,
+                    BufferIterator       buffer, Predicator           pred)
+    {
+        size_t count = last - first;
+        if( last < first || count <= 1 )
+        {
+            return;
+        }
+
+        size_t min_run = algo::_merge_sort_min_run(count);
+        std::vector<size_t> bounds(1, 0);
+        for(size_t start = 0; start < count; bounds.push_back(start))
+        {
+            start += algo::_merge_sort_run(first + start, last, min_run, pred);
+        }
+
+        bool in_buffer = false;
+        for(; bounds.size() > 2; in_buffer = !in_buffer)
+        {
+            if( in_buffer )
+            {
+                algo::_merge_sort_pass(buffer, first, bounds, pred);
+            }
+            else
+            {
+                algo::_merge_sort_pass(first, buffer, bounds, pred);
+            }
+        }
+
+        // an odd number of passes leaves the elements in the buffer
+        for(size_t i = 0; in_buffer && i < count; ++i)
+        {
+            *(first+i) = std::move(*(buffer+i));
+        }
     }
 
+    template<typename RandomAccessIterator>
+    void merge_sort(RandomAccessIterator first, RandomAccessIterator last,
+                    RandomAccessIterator buffer)
+    {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+        algo::merge_sort(first, last, buffer, algo::less<value_type>());
+    }
+
+    // Hints the processor to load the cache line holding p
+    inline void _prefetch(const void* p)
+    {
+        ALGO_PREFETCH(p);
+    }
+
+    // Iterators over elements laid out in an array, whose addresses are
+    // those of the elements: pointers and iterators of std::vector, but
+    // std::vector<bool>, whose elements are proxies
+    template<typename Iterator>
+    class _contiguous
+    {
+        typedef typename std::iterator_traits<Iterator>::value_type value_type;
+
+    public:
+        enum
+        {
+            value = !std::is_same<value_type, bool>::value
+                 && (std::is_same<Iterator, typename std::vector<value_type>::iterator>::value
+                  || std::is_same<Iterator, typename std::vector<value_type>::const_iterator>::value)
+        };
+    };
+
+    template<typename T>
+    class _contiguous<T*>
+    {
+    public:
+        enum { value = true };
+    };
+
+    template<typename Iterator>
+    void _prefetch_at(Iterator it, std::true_type)
+    {
+        algo::_prefetch(std::addressof(*it));
+    }
+
+    template<typename Iterator>
+    void _prefetch_at(Iterator, std::false_type)
+    {
+    }
+
+    // Prefetches the element at it, a valid position. Nothing is loaded
+    // ahead through other iterators than contiguous ones, they may be
+    // proxies, or read their elements when dereferenced.
+    template<typename Iterator>
+    void _prefetch_at(Iterator it)
+    {
+        algo::_prefetch_at(it, std::integral_constant<bool, _contiguous<Iterator>::value>());
+    }
+
+    // The searches below narrow [first, first+n) down to one element without
+    // branching on comparisons: the lower half keeps n-n/2 elements, so both
+    // halves have the same length and first moves by a conditional add. The
+    // probes of the next step, in either half, are prefetched.
+
     // Find the first element within [first, last) that isn't less than the specified value.
     // pred: predicator that defines a strict weak ordering
     template<
@@ -372,19 +916,23 @@ namespace algo
                                      const Element&       value,
                                      Predicator           pred)
     {
-        while( first < last )
+        if( !(first < last) )
         {
-            RandomAccessIterator center = first + (last-first)/2;
-            if( pred(*center, value) )
-            {
-                first = center + 1; // lower bound may fall in [center+1, last]
-            }
-            else // *center >= value
-            {
-                last = center;      // lower bound may fall in [first, center]
-            }
+            return first;
         }
-        return first;
+
+        // the lower bound is within [first, first+n]
+        size_t n = last - first;
+        while( n > 1 )
+        {
+            size_t half = n / 2;
+            size_t next = (n - half) / 2;
+            algo::_prefetch_at(first + next);
+            algo::_prefetch_at(first + half + next);
+            first += pred(*(first + half), value) ? half : 0;
+            n -= half;
+        }
+        return first + (pred(*first, value) ? 1 : 0);
     }
 
     template<
@@ -407,19 +955,23 @@ namespace algo
                                      const Element&       value,
                                      Predicator           pred)
     {
-        while( first < last )
+        if( !(first < last) )
         {
-            RandomAccessIterator center = first + (last-first)/2;
-            if( pred(value, *center) )
-            {
-                last = center;      // upper bound may fall in [first, center]
-            }
-            else // value >= *center
-            {
-                first = center + 1; // upper bound may fall in [center+1, last]
-            }
+            return first;
+        }
+
+        // the upper bound is within [first, first+n]
+        size_t n = last - first;
+        while( n > 1 )
+        {
+            size_t half = n / 2;
+            size_t next = (n - half) / 2;
+            algo::_prefetch_at(first + next);
+            algo::_prefetch_at(first + half + next);
+            first += pred(value, *(first + half)) ? 0 : half;
+            n -= half;
         }
-        return last;
+        return first + (pred(value, *first) ? 0 : 1);
     }
 
     template<
@@ -431,6 +983,101 @@ namespace algo
     {
         return algo::upper_bound(first, last, value, algo::less<Element>());
     }
+
+    // Search for element within the ordered range [first, last)
+    // pred: predicator that defines a strict weak ordering
+    // Returns true if the specified element is found.
+    template<
+        typename RandomAccessIterator,
+        typename Element,
+        typename Predicator>
+    bool binary_search(RandomAccessIterator first,
+                       RandomAccessIterator last,
+                       const Element&       element,
+                       Predicator           pred)
+    {
+        RandomAccessIterator it = algo::lower_bound(first, last, element, pred);
+        return it < last && !pred(element, *it);
+    }
+
+    template<
+        typename RandomAccessIterator,
+        typename Element>
+    bool binary_search(RandomAccessIterator first,
+                       RandomAccessIterator last,
+                       const Element&       element)
+    {
+        return algo::binary_search(first, last, element, algo::less<Element>());
+    }
+
+    // Find the lower bounds within [first, last) of the values in
+    // [values_first, values_last), written to result in the same order.
+    // pred: predicator that defines a strict weak ordering
+    // Searches go in groups, all searches of a group step in lockstep, so
+    // that their cache misses overlap rather than follow one another.
+    template<
+        typename RandomAccessIterator,
+        typename InputIterator,
+        typename OutputIterator,
+        typename Predicator>
+    void lower_bound_many(RandomAccessIterator first,
+                          RandomAccessIterator last,
+                          InputIterator        values_first,
+                          InputIterator        values_last,
+                          OutputIterator       result,
+                          Predicator           pred)
+    {
+        typedef typename std::iterator_traits<InputIterator>::value_type value_type;
+
+        enum { group = 16 }; // searches in flight
+
+        size_t count = first < last ? last - first : 0;
+        while( values_first != values_last )
+        {
+            value_type           values[group];
+            RandomAccessIterator bases[group];
+            size_t m = 0;
+            for(; m < group && values_first != values_last; ++m, ++values_first)
+            {
+                values[m] = *values_first;
+                bases[m]  = first;
+            }
+
+            for(size_t n = count; n > 1; )
+            {
+                size_t half = n / 2;
+                size_t next = (n - half) / 2;
+                for(size_t i = 0; i < m; ++i)
+                {
+                    // the base moved, its next probe is known
+                    bases[i] += pred(*(bases[i] + half), values[i]) ? half : 0;
+                    algo::_prefetch_at(bases[i] + next);
+                }
+                n -= half;
+            }
+
+            for(size_t i = 0; i < m; ++i, ++result)
+            {
+                *result = count && pred(*bases[i], values[i]) ? bases[i] + 1 : bases[i];
+            }
+        }
+    }
+
+    template<
+        typename RandomAccessIterator,
+        typename InputIterator,
+        typename OutputIterator>
+    void lower_bound_many(RandomAccessIterator first,
+                          RandomAccessIterator last,
+                          InputIterator        values_first,
+                          InputIterator        values_last,
+                          OutputIterator       result)
+    {
+        typedef typename std::iterator_traits<InputIterator>::value_type value_type;
+        algo::lower_bound_many(first, last, values_first, values_last, result, algo::less<value_type>());
+    }
 }
 
+#include "small_sort.h"
+
 #endif
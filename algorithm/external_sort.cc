@@ -0,0 +1,256 @@
+#include "external_sort.h"
+
+#include <atomic>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(_MSC_VER)
+#include <io.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+using namespace algo;
+
+
+algo::_external_reader::_external_reader()
+    : _file(nullptr), _pos(0), _size(0), _failed(false)
+{
+}
+
+algo::_external_reader::~_external_reader()
+{
+    if( _pending.valid() )
+    {
+        _pending.wait();
+    }
+    if( _file )
+    {
+        std::fclose(_file);
+    }
+}
+
+bool algo::_external_reader::open(const std::string& path, size_t block)
+{
+    _file = std::fopen(path.c_str(), "rb");
+    if( !_file )
+    {
+        _failed = true;
+        return false;
+    }
+
+    // the reads are as large as the blocks
+    std::setvbuf(_file, nullptr, _IONBF, 0);
+
+    _block.resize(block);
+    _ahead.resize(block);
+    char*      p = &_ahead[0];
+    std::FILE* f = _file;
+    _pending = std::async(std::launch::async, [p, block, f]()
+    {
+        return std::fread(p, 1, block, f);
+    });
+    return true;
+}
+
+bool algo::_external_reader::_next_block()
+{
+    if( !_pending.valid() )
+    {
+        return false;
+    }
+
+    _size = _pending.get();
+    _pos  = 0;
+    _block.swap(_ahead);
+
+    if( _size < _block.size() )
+    {
+        // the end of the file, or an error
+        _failed = std::ferror(_file) != 0;
+    }
+    else
+    {
+        char*      p = &_ahead[0];
+        size_t     n = _ahead.size();
+        std::FILE* f = _file;
+        _pending = std::async(std::launch::async, [p, n, f]()
+        {
+            return std::fread(p, 1, n, f);
+        });
+    }
+    return _size > 0;
+}
+
+bool algo::_external_reader::read(void* p, size_t n)
+{
+    char* out = static_cast<char*>(p);
+    size_t done = 0;
+    while( done < n )
+    {
+        if( _pos == _size && !_next_block() )
+        {
+            // the file ends within the record
+            _failed = _failed || done > 0;
+            return false;
+        }
+
+        size_t part = _size - _pos < n - done ? _size - _pos : n - done;
+        std::memcpy(out + done, &_block[_pos], part);
+        _pos += part;
+        done += part;
+    }
+    return true;
+}
+
+bool algo::_external_reader::read_line(std::string& s)
+{
+    s.clear();
+    for(;;)
+    {
+        if( _pos == _size && !_next_block() )
+        {
+            // the last line may lack its '\n'
+            return !s.empty();
+        }
+
+        const char* begin = &_block[_pos];
+        const char* end   = static_cast<const char*>(std::memchr(begin, '\n', _size - _pos));
+        if( end )
+        {
+            s.append(begin, end);
+            _pos += end - begin + 1;
+            return true;
+        }
+        s.append(begin, _size - _pos);
+        _pos = _size;
+    }
+}
+
+algo::_external_writer::_external_writer()
+    : _file(nullptr), _size(0), _failed(false)
+{
+}
+
+algo::_external_writer::~_external_writer()
+{
+    close();
+}
+
+bool algo::_external_writer::open(const std::string& path, size_t block)
+{
+    _file = std::fopen(path.c_str(), "wb");
+    if( !_file )
+    {
+        _failed = true;
+        return false;
+    }
+
+    std::setvbuf(_file, nullptr, _IONBF, 0);
+    _block.resize(block);
+    _spare.resize(block);
+    _size = 0;
+    return true;
+}
+
+void algo::_external_writer::write(const void* p, size_t n)
+{
+    const char* in = static_cast<const char*>(p);
+    while( n )
+    {
+        size_t part = _block.size() - _size < n ? _block.size() - _size : n;
+        std::memcpy(&_block[_size], in, part);
+        _size += part;
+        in    += part;
+        n     -= part;
+
+        if( _size == _block.size() )
+        {
+            _flush();
+        }
+    }
+}
+
+void algo::_external_writer::_flush()
+{
+    if( _pending.valid() && !_pending.get() )
+    {
+        _failed = true;
+    }
+
+    _block.swap(_spare);
+    const char* p = &_spare[0];
+    size_t      n = _size;
+    std::FILE*  f = _file;
+    _pending = std::async(std::launch::async, [p, n, f]()
+    {
+        return std::fwrite(p, 1, n, f) == n;
+    });
+    _size = 0;
+}
+
+bool algo::_external_writer::close()
+{
+    if( !_file )
+    {
+        return !_failed;
+    }
+
+    if( _size )
+    {
+        _flush();
+    }
+    if( _pending.valid() && !_pending.get() )
+    {
+        _failed = true;
+    }
+    if( std::fclose(_file) != 0 )
+    {
+        _failed = true;
+    }
+    _file = nullptr;
+    return !_failed;
+}
+
+// Creates the file at path unless it exists already, sets errno if not
+static bool create_new(const std::string& path)
+{
+#if defined(_MSC_VER)
+    int fd = _open(path.c_str(), _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE);
+    return fd >= 0 && _close(fd) == 0;
+#else
+    int fd = ::open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0600);
+    return fd >= 0 && ::close(fd) == 0;
+#endif
+}
+
+static unsigned long process_id()
+{
+#if defined(_MSC_VER)
+    return static_cast<unsigned long>(_getpid());
+#else
+    return static_cast<unsigned long>(::getpid());
+#endif
+}
+
+std::string algo::_external_run_path(const std::string& dir)
+{
+    // the process id tells apart the runs of processes sorting into the same
+    // directory, the counter those of this process. A name taken anyway, by
+    // a stale run of a process of the same id, is skipped.
+    static std::atomic<unsigned> counter(0);
+    std::string prefix = dir + "/external_sort." + std::to_string(process_id()) + ".";
+    for(;;)
+    {
+        std::string path = prefix + std::to_string(counter++) + ".run";
+        if( create_new(path) )
+        {
+            return path;
+        }
+        if( errno != EEXIST )
+        {
+            return std::string();
+        }
+    }
+}
@@ -0,0 +1,412 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <utility>
+#include <type_traits>
+
+#include "algorithm.h"
+
+namespace algo
+{
+    // Reads a file sequentially in blocks. The block after the current one is
+    // read by another thread while the current one is consumed.
+    class _external_reader
+    {
+    public:
+        _external_reader();
+        ~_external_reader();
+
+        bool open(const std::string& path, size_t block);
+
+        // reads n bytes into p, false at the end of the file or on an error
+        bool read(void* p, size_t n);
+
+        // reads the next line into s without its '\n', false at the end of
+        // the file or on an error
+        bool read_line(std::string& s);
+
+        // whether reading stopped on an error rather than at the end
+        bool failed() const { return _failed; }
+
+    private:
+        _external_reader(const _external_reader&);
+        _external_reader& operator= (const _external_reader&);
+
+        // makes the block read ahead current and starts reading the next one,
+        // false if there is nothing left
+        bool _next_block();
+
+        std::FILE*          _file;
+        std::vector<char>   _block;
+        std::vector<char>   _ahead;
+        size_t              _pos;
+        size_t              _size;
+        std::future<size_t> _pending;  // read into _ahead
+        bool                _failed;
+    };
+
+    // Writes a file sequentially in blocks. A full block is written by
+    // another thread while the next one is filled.
+    class _external_writer
+    {
+    public:
+        _external_writer();
+        ~_external_writer();
+
+        bool open(const std::string& path, size_t block);
+        void write(const void* p, size_t n);
+
+        // writes what is left and closes the file, true if all went well
+        bool close();
+
+    private:
+        _external_writer(const _external_writer&);
+        _external_writer& operator= (const _external_writer&);
+
+        // hands the current block over to be written
+        void _flush();
+
+        std::FILE*        _file;
+        std::vector<char> _block;
+        std::vector<char> _spare;
+        size_t            _size;
+        std::future<bool> _pending;  // write of _spare
+        bool              _failed;
+    };
+
+    // Creates an empty run file in directory dir under a name no other file
+    // there has, and returns its path, or an empty string if it could not be
+    // created
+    std::string _external_run_path(const std::string& dir);
+
+    // Files of fixed-size binary records, stored as their bytes
+    template<typename T>
+    class _external_records
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "binary records must be trivially copyable");
+
+    public:
+        typedef T value_type;
+
+        static bool read(_external_reader& in, T& v) { return in.read(&v, sizeof(T)); }
+        static void write(_external_writer& out, const T& v) { out.write(&v, sizeof(T)); }
+        static size_t footprint(const T&) { return sizeof(T); }
+    };
+
+    // Text files of lines ending with '\n', which the last line may lack
+    class _external_lines
+    {
+    public:
+        typedef std::string value_type;
+
+        static bool read(_external_reader& in, std::string& s) { return in.read_line(s); }
+
+        static void write(_external_writer& out, const std::string& s)
+        {
+            out.write(s.data(), s.size());
+            out.write("\n", 1);
+        }
+
+        static size_t footprint(const std::string& s) { return sizeof(std::string) + s.size(); }
+    };
+
+    // Reads records into chunk until they take budget bytes, at least one
+    // record however small budget is, returns false once the input is
+    // exhausted
+    template<typename Format>
+    bool _external_read_chunk(_external_reader&                            in,
+                              std::vector<typename Format::value_type>&    chunk,
+                              size_t                                       budget)
+    {
+        typename Format::value_type v;
+        size_t used = 0;
+        chunk.clear();
+        do
+        {
+            if( !Format::read(in, v) )
+            {
+                return false;
+            }
+            used += Format::footprint(v);
+            chunk.push_back(std::move(v));
+        }
+        while( used < budget );
+        return true;
+    }
+
+    template<typename Format>
+    bool _external_write_run(const std::vector<typename Format::value_type>& chunk,
+                             const std::string&                              path,
+                             size_t                                          block)
+    {
+        _external_writer out;
+        if( !out.open(path, block) )
+        {
+            return false;
+        }
+        for(size_t i = 0; i < chunk.size(); ++i)
+        {
+            Format::write(out, chunk[i]);
+        }
+        return out.close();
+    }
+
+    // Moves down the run at heap[pos] of the binary heap of runs, ordered by
+    // their current records, the least on top
+    template<
+        typename T,
+        typename Predicator>
+    void _external_sift_down(std::vector<size_t>& heap,
+                             const std::vector<T>& heads,
+                             size_t                pos,
+                             Predicator&           pred)
+    {
+        size_t count = heap.size();
+        size_t run = heap[pos];
+        for(size_t child = 2 * pos + 1; child < count; child = 2 * pos + 1)
+        {
+            if( child + 1 < count && pred(heads[heap[child+1]], heads[heap[child]]) )
+            {
+                ++child;
+            }
+            if( !pred(heads[heap[child]], heads[run]) )
+            {
+                break;
+            }
+            heap[pos] = heap[child];
+            pos = child;
+        }
+        heap[pos] = run;
+    }
+
+    // Merges the sorted runs [first, last) of runs into the file at path
+    template<
+        typename Format,
+        typename Predicator>
+    bool _external_merge(const std::vector<std::string>& runs,
+                         size_t                          first,
+                         size_t                          last,
+                         const std::string&              path,
+                         Predicator                      pred,
+                         size_t                          block)
+    {
+        typedef typename Format::value_type value_type;
+
+        size_t count = last - first;
+        std::vector<std::unique_ptr<_external_reader> > in(count);
+        std::vector<value_type> heads(count);
+        std::vector<size_t>     heap;
+        for(size_t i = 0; i < count; ++i)
+        {
+            in[i].reset(new _external_reader());
+            if( !in[i]->open(runs[first + i], block) )
+            {
+                return false;
+            }
+            if( Format::read(*in[i], heads[i]) )
+            {
+                heap.push_back(i);
+            }
+        }
+        for(size_t i = heap.size() / 2; i-- > 0; )
+        {
+            algo::_external_sift_down(heap, heads, i, pred);
+        }
+
+        _external_writer out;
+        if( !out.open(path, block) )
+        {
+            return false;
+        }
+
+        while( !heap.empty() )
+        {
+            size_t run = heap[0];
+            Format::write(out, heads[run]);
+            if( !Format::read(*in[run], heads[run]) )
+            {
+                heap[0] = heap.back();
+                heap.pop_back();
+            }
+            if( !heap.empty() )
+            {
+                algo::_external_sift_down(heap, heads, 0, pred);
+            }
+        }
+
+        bool failed = false;
+        for(size_t i = 0; i < count; ++i)
+        {
+            failed = failed || in[i]->failed();
+        }
+        return out.close() && !failed;
+    }
+
+    inline void _external_remove(const std::vector<std::string>& runs, size_t first, size_t last)
+    {
+        for(size_t i = first; i < last; ++i)
+        {
+            std::remove(runs[i].c_str());
+        }
+    }
+
+    enum
+    {
+        _external_min_block  = 4096,
+        _external_max_block  = 1 << 20,
+        _external_min_memory = 8 * _external_min_block  // fan-in of 3
+    };
+
+    // Sorts the records of Format in file input into file output.
+    // Run generation rotates three chunks of a third of the memory each: the
+    // next one is read while the current one is sorted and the previous one
+    // is written out as a run. Runs are then merged up to fan_in at a time,
+    // the readers and the writer of a merge holding two blocks each, one
+    // being consumed or filled while the other is read or written.
+    template<
+        typename Format,
+        typename Predicator>
+    bool _external_sort(const std::string& input,
+                        const std::string& output,
+                        Predicator         pred,
+                        size_t             memory,
+                        const std::string& temp_dir)
+    {
+        typedef typename Format::value_type value_type;
+
+        memory = memory < _external_min_memory ? size_t(_external_min_memory) : memory;
+        size_t block = memory / 16;
+        block = block < _external_min_block ? size_t(_external_min_block) :
+                block > _external_max_block ? size_t(_external_max_block) : block;
+        size_t fan_in = memory / (2 * block) - 1;
+        fan_in = fan_in < 2 ? 2 : fan_in;
+
+        _external_reader in;
+        if( !in.open(input, block) )
+        {
+            return false;
+        }
+
+        std::vector<std::string> runs;
+        std::vector<value_type>  chunks[3];
+        std::future<bool>        reading = std::async(std::launch::async, [&]()
+        {
+            return algo::_external_read_chunk<Format>(in, chunks[0], memory / 3);
+        });
+        std::future<bool>        writing;
+        bool                     ok = true;
+        for(size_t i = 0; ; ++i)
+        {
+            std::vector<value_type>& chunk = chunks[i % 3];
+            bool more = reading.get();
+            if( !more && chunk.empty() && i > 0 )
+            {
+                break;
+            }
+
+            // the chunk after this one was written out as run i-2
+            if( more )
+            {
+                std::vector<value_type>* next = &chunks[(i + 1) % 3];
+                reading = std::async(std::launch::async, [&in, next, memory]()
+                {
+                    return algo::_external_read_chunk<Format>(in, *next, memory / 3);
+                });
+            }
+
+            algo::quick_sort(chunk.begin(), chunk.end(), pred);
+
+            if( writing.valid() )
+            {
+                ok = writing.get() && ok;
+            }
+
+            // a single chunk is the output already
+            runs.push_back(i == 0 && !more ? output : algo::_external_run_path(temp_dir));
+            const std::string& path = runs.back();
+            writing = std::async(std::launch::async, [&chunk, path, block]()
+            {
+                return algo::_external_write_run<Format>(chunk, path, block);
+            });
+
+            if( !more )
+            {
+                break;
+            }
+        }
+        ok = writing.get() && ok && !in.failed();
+
+        if( runs.size() == 1 && runs[0] == output )
+        {
+            return ok;
+        }
+
+        while( ok && runs.size() > fan_in )
+        {
+            std::vector<std::string> merged;
+            for(size_t i = 0; i < runs.size(); i += fan_in)
+            {
+                size_t last = i + fan_in < runs.size() ? i + fan_in : runs.size();
+                if( ok )
+                {
+                    merged.push_back(algo::_external_run_path(temp_dir));
+                    ok = algo::_external_merge<Format>(runs, i, last, merged.back(), pred, block);
+                }
+                algo::_external_remove(runs, i, last);
+            }
+            runs.swap(merged);
+        }
+
+        ok = ok && algo::_external_merge<Format>(runs, 0, runs.size(), output, pred, block);
+        algo::_external_remove(runs, 0, runs.size());
+        return ok;
+    }
+
+    // Sorts the binary file input, of records of type T, into file output.
+    // pred:     predicator that defines a strict weak ordering
+    // memory:   bytes of records held in memory at a time, 32KB at least
+    // temp_dir: directory of the sorted runs written on the way
+    // Returns false if a file could not be read or written, or input ends
+    // with part of a record. Not stable.
+    template<
+        typename T,
+        typename Predicator>
+    bool external_sort(const std::string& input,
+                       const std::string& output,
+                       Predicator         pred,
+                       size_t             memory   = size_t(256) << 20,
+                       const std::string& temp_dir = ".")
+    {
+        return algo::_external_sort<_external_records<T> >(input, output, pred, memory, temp_dir);
+    }
+
+    template<typename T>
+    bool external_sort(const std::string& input, const std::string& output)
+    {
+        return algo::external_sort<T>(input, output, algo::less<T>());
+    }
+
+    // Same as external_sort(), sorts the lines of text file input. Every
+    // line of output ends with '\n'.
+    template<typename Predicator>
+    bool external_sort_lines(const std::string& input,
+                             const std::string& output,
+                             Predicator         pred,
+                             size_t             memory   = size_t(256) << 20,
+                             const std::string& temp_dir = ".")
+    {
+        return algo::_external_sort<_external_lines>(input, output, pred, memory, temp_dir);
+    }
+
+    inline bool external_sort_lines(const std::string& input, const std::string& output)
+    {
+        return algo::external_sort_lines(input, output, algo::less<std::string>());
+    }
+}
+
+#endif
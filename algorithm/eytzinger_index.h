@@ -0,0 +1,127 @@
+#ifndef EYTZINGER_INDEX_H
+#define EYTZINGER_INDEX_H
+
+#include <vector>
+#include <cstddef>
+
+#include "algorithm.h"
+
+namespace algo
+{
+    // Read-only search index over a sorted range, answering lower_bound and
+    // upper_bound with positions in that range.
+    // Elements are stored in the breadth-first order of a complete binary
+    // search tree (Eytzinger layout): the children of node k are 2k and
+    // 2k+1. The first levels of the tree share a few cache lines and stay
+    // cached, and the search reads nodes at known positions, so it prefetches
+    // the line holding the 16 descendants four levels below, a whole cache
+    // line of 4-byte keys.
+    template<typename T, typename Predicator = algo::less<T> >
+    class eytzinger_index
+    {
+    public:
+        typedef eytzinger_index<T, Predicator> my_type;
+        typedef T                              value_type;
+
+        explicit eytzinger_index(Predicator pred = Predicator())
+            : _tree(1), _bottom(1), _pred(pred) {}
+
+        template<typename RandomAccessIterator>
+        eytzinger_index(RandomAccessIterator first, RandomAccessIterator last, Predicator pred = Predicator())
+            : _pred(pred)
+        {
+            assign(first, last);
+        }
+
+        // build the index of the sorted range [first, last)
+        template<typename RandomAccessIterator>
+        void assign(RandomAccessIterator first, RandomAccessIterator last);
+
+        // Position of the first element not less than value in the range the
+        // index was built from, size() if there is none
+        size_t lower_bound(const T& value) const
+        {
+            size_t n = _tree.size();
+            size_t k = 1;
+            while( k < n )
+            {
+                _prefetch_descendants(k);
+                k = 2 * k + (_pred(_tree[k], value) ? 1 : 0);
+            }
+            return _position(k);
+        }
+
+        // Position of the first element greater than value, size() if there
+        // is none
+        size_t upper_bound(const T& value) const
+        {
+            size_t n = _tree.size();
+            size_t k = 1;
+            while( k < n )
+            {
+                _prefetch_descendants(k);
+                k = 2 * k + (_pred(value, _tree[k]) ? 0 : 1);
+            }
+            return _position(k);
+        }
+
+        size_t size() const { return _tree.size() - 1; }
+
+    private:
+        enum { prefetch_levels = 4 };
+
+        // fill the subtree of node k in order from first[i], returns the
+        // position after its last element
+        template<typename RandomAccessIterator>
+        size_t _build(RandomAccessIterator first, size_t i, size_t k);
+
+        // Position in the sorted range of the gap at the empty child k where
+        // a search ended. Empty children below the bottom level come first in
+        // order, followed by those of the bottom level.
+        size_t _position(size_t k) const
+        {
+            return k - _bottom + (k < _bottom ? _tree.size() : 0);
+        }
+
+        void _prefetch_descendants(size_t k) const
+        {
+            // the descendants may be past the end, the address is only a hint
+            size_t base = reinterpret_cast<size_t>(&_tree[0]);
+            algo::_prefetch(reinterpret_cast<const void*>(base + (k << prefetch_levels) * sizeof(T)));
+        }
+
+        std::vector<T> _tree;    // nodes from 1, _tree[0] is unused
+        size_t         _bottom;  // first node below the bottom level
+        Predicator     _pred;
+    };
+
+    template<typename T, typename Predicator>
+    template<typename RandomAccessIterator>
+    void eytzinger_index<T, Predicator>::assign(RandomAccessIterator first, RandomAccessIterator last)
+    {
+        size_t n = first < last ? last - first : 0;
+        _tree.assign(n + 1, T());
+        _build(first, 0, 1);
+
+        _bottom = 1;
+        while( _bottom <= n )
+        {
+            _bottom *= 2;
+        }
+    }
+
+    template<typename T, typename Predicator>
+    template<typename RandomAccessIterator>
+    size_t eytzinger_index<T, Predicator>::_build(RandomAccessIterator first, size_t i, size_t k)
+    {
+        if( k < _tree.size() )
+        {
+            i = _build(first, i, 2 * k);
+            _tree[k] = *(first + i++);
+            i = _build(first, i, 2 * k + 1);
+        }
+        return i;
+    }
+}
+
+#endif
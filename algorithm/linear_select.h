@@ -1,5 +1,8 @@
 #pragma once
 #include <vector>
+#include <utility>
+
+#include "algorithm.h"
 
 namespace algo
 {
@@ -11,13 +14,13 @@ namespace algo
             if( seq[i] < seq[i-1] )
             {
                 size_t j = i;
-                T t = seq[j];
-                while( t < seq[j-1] && j > 0 )
+                T t = std::move(seq[j]);
+                while( j > 0 && t < seq[j-1] )
                 {
-                    seq[j] = seq[j-1];
+                    seq[j] = std::move(seq[j-1]);
                     --j;
                 }
-                seq[j] = t;
+                seq[j] = std::move(t);
             }
         }
     }
@@ -48,9 +51,7 @@ namespace algo
 
             if( l < r )
             {
-                T t = *l;
-                *l = *r;
-                *r = t;
+                algo::swap(*l, *r);
                 ++l;
                 --r;
             }
@@ -75,10 +76,11 @@ namespace algo
             mids.push_back( algo::middle_of(seq + 5*i, 5) );
         }
 
-        mids.push_back(algo::middle_of(seq + 5 * (groups - 1), length % 5));
+        // the last group holds 1 to 5 elements
+        mids.push_back(algo::middle_of(seq + 5 * (groups - 1), length - 5 * (groups - 1)));
         T midmids = algo::middle_of(&(mids[0]), mids.size());
 
-        size_t k = algo::partition(seq, length, midmids) + 1;
+        size_t k = algo::partition(seq, length, std::move(midmids)) + 1;
         if( n == k )
         {
             return seq[k-1];
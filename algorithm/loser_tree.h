@@ -0,0 +1,212 @@
+#ifndef LOSER_TREE_H
+#define LOSER_TREE_H
+
+#include <vector>
+#include <utility>
+#include <iterator>
+
+#include "algorithm.h"
+
+namespace algo
+{
+    // Tournament tree of losers over the current elements of k sorted
+    // sources, to take their elements in order one at a time.
+    // Sources are the leaves n..2n-1 of an implicit binary tree, n the power
+    // of 2 not less than k. Every inner node holds the source that lost the
+    // match there, node 0 the overall winner. When the winner is replaced by
+    // the next element of its source, only the matches on its path are
+    // replayed, against the losers stored there, which come from the other
+    // side: log2(k) comparisons, and the nodes read are a contiguous array of
+    // source numbers. Leaves past k and exhausted sources are the sentinel
+    // none, which loses every match without a comparison, so a match of two
+    // sources is a single call of the predicator. Ties go to the left side,
+    // the lower source, so merges are stable.
+    template<typename T, typename Predicator = algo::less<T> >
+    class loser_tree
+    {
+    public:
+        typedef loser_tree<T, Predicator> my_type;
+        typedef T                         value_type;
+
+        explicit loser_tree(size_t sources, Predicator pred = Predicator())
+            : _leaves(1),
+              _values(sources),
+              _pred(pred)
+        {
+            while( _leaves < sources )
+            {
+                _leaves *= 2;
+            }
+            _losers.assign(_leaves, none);
+            _set.assign(sources, 0);
+        }
+
+        // sets the first element of a source, sources never set are empty
+        void init(size_t source, value_type v)
+        {
+            _values[source] = std::move(v);
+            _set[source]    = 1;
+        }
+
+        // plays all matches, after every source has been set
+        void build();
+
+        // whether all sources are exhausted
+        bool empty() const { return _losers[0] == none; }
+
+        // the source of the least current element
+        size_t top() const { return _losers[0]; }
+
+        // the least current element
+        value_type& front() { return _values[_losers[0]]; }
+
+        // replaces the least element by the next one of its source
+        void next(value_type v)
+        {
+            size_t winner = _losers[0];
+            _values[winner] = std::move(v);
+            _replay(winner + _leaves, winner);
+        }
+
+        // marks the source of the least element exhausted
+        void close()
+        {
+            // the first source stored on the path beats the exhausted one
+            // and plays the rest of the way
+            for(size_t node = _losers[0] + _leaves; node > 1; node /= 2)
+            {
+                size_t& slot   = _losers[node / 2];
+                size_t  winner = slot;
+                if( winner != none )
+                {
+                    slot = none;
+                    _replay(node / 2, winner);
+                    return;
+                }
+            }
+            _losers[0] = none;
+        }
+
+    private:
+        enum { none = ~size_t(0) };
+
+        // plays the matches above node on the path of the live source winner,
+        // coming up from node. Coming from the right child the loser stored
+        // at the parent is on the left and wins ties.
+        void _replay(size_t node, size_t winner)
+        {
+            const value_type* value = &_values[winner];
+            for(; node > 1; node /= 2)
+            {
+                size_t& slot  = _losers[node / 2];
+                size_t  loser = slot;
+                if( loser == none )
+                {
+                    continue;
+                }
+
+                // selected rather than branched on, the outcome is a toss-up
+                const value_type* other = &_values[loser];
+                bool wins = (node & 1) ? !_pred(*value, *other) : _pred(*other, *value);
+                slot   = wins ? winner : loser;
+                winner = wins ? loser : winner;
+                value  = wins ? other : value;
+            }
+            _losers[0] = winner;
+        }
+
+        size_t                  _leaves;
+        std::vector<size_t>     _losers;  // node 0 holds the winner
+        std::vector<value_type> _values;  // current element of each source
+        std::vector<char>       _set;     // whether init() set a source
+        Predicator              _pred;
+    };
+
+    template<typename T, typename Predicator>
+    void loser_tree<T, Predicator>::build()
+    {
+        // the winners of the inner nodes, leaves are their sources
+        std::vector<size_t> winners(2 * _leaves, size_t(none));
+        for(size_t i = 0; i < _set.size(); ++i)
+        {
+            winners[_leaves + i] = _set[i] ? i : size_t(none);
+        }
+        for(size_t node = _leaves - 1; node > 0; --node)
+        {
+            // the left one wins ties
+            size_t a = winners[2 * node];
+            size_t b = winners[2 * node + 1];
+            bool   a_wins = b == none || (a != none && !_pred(_values[b], _values[a]));
+            winners[node] = a_wins ? a : b;
+            _losers[node] = a_wins ? b : a;
+        }
+        _losers[0] = winners[1];
+    }
+
+    // Merges sorted ranges into result, like merge() does two of them.
+    // ranges_first, ranges_last: range of pairs of input iterators, each
+    //  pair a sorted range
+    // pred: predicator that defines a strict weak ordering
+    // Elements are taken from a loser_tree, log2(k) comparisons each for k
+    // ranges. The ranges are read once each, front to back, so they can be
+    // streams. Equal elements come in the order of their ranges.
+    // Returns the end of the output.
+    template<
+        typename RangeIterator,
+        typename OutputIterator,
+        typename Predicator>
+    OutputIterator merge_k(RangeIterator  ranges_first,
+                           RangeIterator  ranges_last,
+                           OutputIterator result,
+                           Predicator     pred)
+    {
+        typedef typename std::iterator_traits<RangeIterator>::value_type  range_type;
+        typedef typename range_type::first_type                           input_iterator;
+        typedef typename std::iterator_traits<input_iterator>::value_type value_type;
+
+        std::vector<range_type> ranges(ranges_first, ranges_last);
+        loser_tree<value_type, Predicator> tree(ranges.size(), pred);
+        for(size_t i = 0; i < ranges.size(); ++i)
+        {
+            if( ranges[i].first != ranges[i].second )
+            {
+                tree.init(i, *ranges[i].first);
+                ++ranges[i].first;
+            }
+        }
+        tree.build();
+
+        while( !tree.empty() )
+        {
+            range_type& r = ranges[tree.top()];
+            *result = std::move(tree.front());
+            ++result;
+
+            if( r.first != r.second )
+            {
+                tree.next(*r.first);
+                ++r.first;
+            }
+            else
+            {
+                tree.close();
+            }
+        }
+        return result;
+    }
+
+    template<
+        typename RangeIterator,
+        typename OutputIterator>
+    OutputIterator merge_k(RangeIterator  ranges_first,
+                           RangeIterator  ranges_last,
+                           OutputIterator result)
+    {
+        typedef typename std::iterator_traits<RangeIterator>::value_type  range_type;
+        typedef typename range_type::first_type                           input_iterator;
+        typedef typename std::iterator_traits<input_iterator>::value_type value_type;
+        return algo::merge_k(ranges_first, ranges_last, result, algo::less<value_type>());
+    }
+}
+
+#endif
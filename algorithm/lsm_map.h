@@ -0,0 +1,546 @@
+#ifndef LSM_MAP_H
+#define LSM_MAP_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <iterator>
+
+#include "algorithm.h"
+
+namespace algo
+{
+    // Write-optimized sorted map made of a small write buffer, hashed by key,
+    // and immutable sorted runs, organized in levels.
+    // A full buffer is sealed and handed to a background thread, which sorts
+    // it into a run of level 0. Once a level holds fanout runs they are merged
+    // into one run of the next level, thus every pair is written once per
+    // level. A larger fanout means fewer levels and less writing, but more
+    // runs to search. Every run has a bloom filter, so a lookup reads only
+    // the runs likely to hold the key.
+    //  buffer_size: number of keys buffered before they are sorted
+    //  fanout:      number of runs of a level merged together
+    //  filter_bits: bits per key of the bloom filters
+    template<typename K, typename V>
+    class lsm_map
+    {
+    public:
+        typedef lsm_map<K, V>   my_type;
+        typedef std::pair<K, V> value_type;
+        typedef K               key_type;
+
+        explicit lsm_map(size_t buffer_size = 4096, size_t fanout = 4, size_t filter_bits = 10);
+        ~lsm_map();
+
+        // insert a key-value pair, overwrite existing value
+        void insert(const value_type& val) { write(entry(val.first, val.second, false)); }
+
+        // erase a key-value pair
+        void erase(const key_type& k) { write(entry(k, V(), true)); }
+
+        // search for key k, copy its value to v, returns false if it is not found
+        bool find(const key_type& k, V& v);
+
+        // sort the buffer into a run and wait until no level is full
+        void flush();
+
+        // number of sorted runs, i.e. most runs searched by a lookup
+        size_t runs();
+
+        // number of pairs written into runs per pair written into the map
+        double write_amplification();
+
+    private:
+        // a write, erased ones hide older values of the key
+        class entry
+        {
+        public:
+            entry(): erased(false) {}
+            entry(const K& k, const V& v, bool e): key(k), value(v), erased(e) {}
+
+            bool operator< (const entry& another) const { return key < another.key; }
+
+            K    key;
+            V    value;
+            bool erased;
+        };
+        typedef std::vector<entry> entry_v;
+
+        // Writes not sorted yet, the latest one of every key. An open
+        // addressing table of positions finds the entry of a key, thus
+        // lookups never scan a buffer.
+        class buffer
+        {
+        public:
+            explicit buffer(size_t capacity);
+
+            // entry of key k, nullptr if k is not buffered
+            const entry* lookup(const K& k) const;
+
+            // add e or overwrite the entry of its key
+            void write(const entry& e);
+
+            void swap(buffer& another)
+            {
+                entries.swap(another.entries);
+                _slots.swap(another._slots);
+            }
+
+            entry_v entries;
+
+        private:
+            // slot of key k, or the empty one where k goes
+            size_t slot(const K& k) const;
+
+            std::vector<size_t> _slots; // position + 1 in entries, 0 if empty
+        };
+
+        // Bloom filter, the probes of a key are derived from one hash
+        class filter
+        {
+        public:
+            filter(size_t keys, size_t bits_per_key);
+
+            void add(const K& k);
+            bool may_contain(const K& k) const;
+
+        private:
+            std::vector<unsigned long long> _bits;
+            size_t                          _probes;
+        };
+
+        // ordered entries with unique keys
+        class run
+        {
+        public:
+            run(entry_v& sorted, size_t filter_bits);
+
+            entry_v entries;
+            filter  keys;
+        };
+        typedef std::shared_ptr<const run>     run_ptr;
+        typedef std::shared_ptr<const buffer>  buffer_ptr;
+
+        // Runs and sealed buffers as seen by lookups, immutable once
+        // published. Later ones are newer in both.
+        class state
+        {
+        public:
+            std::vector<buffer_ptr>           sealed;
+            std::vector<std::vector<run_ptr> > levels;
+        };
+        typedef std::shared_ptr<const state> state_ptr;
+
+        void write(const entry& e);
+
+        // background thread, turns sealed buffers into runs and merges
+        // full levels
+        void compact();
+
+        // level holding fanout runs, npos if none
+        size_t full_level(const state& s) const;
+
+        // merge runs, newest first, into one run; erased entries are dropped
+        // if nothing older is left below
+        run_ptr merge_runs(const std::vector<run_ptr>& runs, bool bottom) const;
+
+        enum { npos = size_t(-1) };
+
+        lsm_map(const my_type&);
+        my_type& operator= (const my_type&);
+
+    private:
+        size_t _buffer_size;
+        size_t _fanout;
+        size_t _filter_bits;
+
+        std::mutex              _mutex;     // guards all below
+        std::condition_variable _work;      // wakes the compaction thread
+        std::condition_variable _done;      // wakes writers and flush
+        buffer                  _buffer;
+        state_ptr               _state;
+        bool                    _busy;      // compaction thread is working
+        bool                    _stop;
+        unsigned long long      _written;   // entries written into the map
+        unsigned long long      _stored;    // entries written into runs
+        std::thread             _compactor;
+    };
+
+    template<typename K, typename V>
+    lsm_map<K, V>::filter::filter(size_t keys, size_t bits_per_key)
+        : _bits((keys * bits_per_key + 63) / 64 + 1, 0)
+    {
+        // k = ln2 * bits per key minimizes false positives
+        _probes = bits_per_key * 69 / 100;
+        if( _probes < 1 )  { _probes = 1; }
+        if( _probes > 30 ) { _probes = 30; }
+    }
+
+    template<typename K, typename V>
+    void lsm_map<K, V>::filter::add(const K& k)
+    {
+        unsigned long long h = std::hash<K>()(k) * 0x9e3779b97f4a7c15ULL;
+        unsigned long long delta = (h >> 17) | (h << 47) | 1;
+        unsigned long long bits = _bits.size() * 64;
+        for(size_t i = 0; i < _probes; ++i, h += delta)
+        {
+            _bits[size_t(h % bits / 64)] |= 1ULL << (h % bits % 64);
+        }
+    }
+
+    template<typename K, typename V>
+    bool lsm_map<K, V>::filter::may_contain(const K& k) const
+    {
+        unsigned long long h = std::hash<K>()(k) * 0x9e3779b97f4a7c15ULL;
+        unsigned long long delta = (h >> 17) | (h << 47) | 1;
+        unsigned long long bits = _bits.size() * 64;
+        for(size_t i = 0; i < _probes; ++i, h += delta)
+        {
+            if( !(_bits[size_t(h % bits / 64)] & (1ULL << (h % bits % 64))) )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename K, typename V>
+    lsm_map<K, V>::buffer::buffer(size_t capacity)
+    {
+        // at most half of the slots are taken
+        size_t slots = 2;
+        while( slots < 2 * capacity )
+        {
+            slots *= 2;
+        }
+        _slots.resize(slots, 0);
+        entries.reserve(capacity);
+    }
+
+    template<typename K, typename V>
+    size_t lsm_map<K, V>::buffer::slot(const K& k) const
+    {
+        unsigned long long h = std::hash<K>()(k) * 0x9e3779b97f4a7c15ULL;
+        size_t mask = _slots.size() - 1;
+        for(size_t i = size_t(h ^ (h >> 32)) & mask; ; i = (i + 1) & mask)
+        {
+            size_t p = _slots[i];
+            if( !p || (!(entries[p-1].key < k) && !(k < entries[p-1].key)) )
+            {
+                return i;
+            }
+        }
+    }
+
+    template<typename K, typename V>
+    const typename lsm_map<K, V>::entry* lsm_map<K, V>::buffer::lookup(const K& k) const
+    {
+        size_t p = _slots[slot(k)];
+        return p ? &entries[p-1] : nullptr;
+    }
+
+    template<typename K, typename V>
+    void lsm_map<K, V>::buffer::write(const entry& e)
+    {
+        size_t& p = _slots[slot(e.key)];
+        if( p )
+        {
+            entries[p-1] = e;
+            return;
+        }
+        entries.push_back(e);
+        p = entries.size();
+    }
+
+    template<typename K, typename V>
+    lsm_map<K, V>::run::run(entry_v& sorted, size_t filter_bits)
+        : keys(sorted.size(), filter_bits)
+    {
+        entries.swap(sorted);
+        for(size_t i = 0; i < entries.size(); ++i)
+        {
+            keys.add(entries[i].key);
+        }
+    }
+
+    template<typename K, typename V>
+    lsm_map<K, V>::lsm_map(size_t buffer_size, size_t fanout, size_t filter_bits)
+        : _buffer_size(buffer_size ? buffer_size : 1),
+          _fanout(fanout < 2 ? 2 : fanout),
+          _filter_bits(filter_bits),
+          _buffer(_buffer_size),
+          _state(new state()),
+          _busy(false),
+          _stop(false),
+          _written(0),
+          _stored(0)
+    {
+        _compactor = std::thread(&my_type::compact, this);
+    }
+
+    template<typename K, typename V>
+    lsm_map<K, V>::~lsm_map()
+    {
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            _stop = true;
+        }
+        _work.notify_one();
+        _compactor.join();
+    }
+
+    template<typename K, typename V>
+    void lsm_map<K, V>::write(const entry& e)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _buffer.write(e);
+        ++_written;
+        if( _buffer.entries.size() < _buffer_size )
+        {
+            return;
+        }
+
+        // writers wait while the compaction thread is behind by fanout buffers
+        while( _state->sealed.size() >= _fanout )
+        {
+            _done.wait(lock);
+        }
+
+        std::shared_ptr<state> next(new state(*_state));
+        std::shared_ptr<buffer> sealed(new buffer(_buffer_size));
+        sealed->swap(_buffer);
+        next->sealed.push_back(sealed);
+        _state = next;
+        _work.notify_one();
+    }
+
+    template<typename K, typename V>
+    bool lsm_map<K, V>::find(const key_type& k, V& v)
+    {
+        state_ptr s;
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            if( const entry* e = _buffer.lookup(k) )
+            {
+                v = e->value;
+                return !e->erased;
+            }
+            s = _state;
+        }
+
+        for(size_t n = s->sealed.size(); n != 0; --n)
+        {
+            if( const entry* e = s->sealed[n-1]->lookup(k) )
+            {
+                v = e->value;
+                return !e->erased;
+            }
+        }
+
+        entry target(k, V(), false);
+        for(size_t l = 0; l < s->levels.size(); ++l)
+        {
+            const std::vector<run_ptr>& level = s->levels[l];
+            for(size_t n = level.size(); n != 0; --n)
+            {
+                const run& r = *level[n-1];
+                if( !r.keys.may_contain(k) )
+                {
+                    continue;
+                }
+
+                typename entry_v::const_iterator it = algo::lower_bound(r.entries.begin(), r.entries.end(), target);
+                if( it != r.entries.end() && !(k < it->key) )
+                {
+                    v = it->value;
+                    return !it->erased;
+                }
+            }
+        }
+        return false;
+    }
+
+    template<typename K, typename V>
+    void lsm_map<K, V>::flush()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if( !_buffer.entries.empty() )
+        {
+            std::shared_ptr<state> next(new state(*_state));
+            std::shared_ptr<buffer> sealed(new buffer(_buffer_size));
+            sealed->swap(_buffer);
+            next->sealed.push_back(sealed);
+            _state = next;
+            _work.notify_one();
+        }
+
+        while( _busy || !_state->sealed.empty() || full_level(*_state) != npos )
+        {
+            _done.wait(lock);
+        }
+    }
+
+    template<typename K, typename V>
+    size_t lsm_map<K, V>::runs()
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        size_t count = 0;
+        for(size_t l = 0; l < _state->levels.size(); ++l)
+        {
+            count += _state->levels[l].size();
+        }
+        return count;
+    }
+
+    template<typename K, typename V>
+    double lsm_map<K, V>::write_amplification()
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _written ? double(_stored) / double(_written) : 0.0;
+    }
+
+    template<typename K, typename V>
+    size_t lsm_map<K, V>::full_level(const state& s) const
+    {
+        for(size_t l = 0; l < s.levels.size(); ++l)
+        {
+            if( s.levels[l].size() >= _fanout )
+            {
+                return l;
+            }
+        }
+        return npos;
+    }
+
+    template<typename K, typename V>
+    void lsm_map<K, V>::compact()
+    {
+        // Only this thread changes the levels, writers only add sealed
+        // buffers, thus work taken from a state is still there when the
+        // result is published.
+        std::unique_lock<std::mutex> lock(_mutex);
+        for(;;)
+        {
+            _busy = false;
+            _done.notify_all();
+            while( !_stop && _state->sealed.empty() && full_level(*_state) == npos )
+            {
+                _work.wait(lock);
+            }
+            if( _stop )
+            {
+                return;
+            }
+            _busy = true;
+
+            state_ptr s = _state;
+            size_t l = full_level(*s);
+            if( !s->sealed.empty() )
+            {
+                buffer_ptr b = s->sealed.front();
+                lock.unlock();
+
+                // keys of a buffer are unique already
+                entry_v sorted(b->entries), scratch(sorted.size());
+                algo::merge_sort(sorted.begin(), sorted.end(), scratch.begin());
+                run_ptr r(new run(sorted, _filter_bits));
+
+                lock.lock();
+                std::shared_ptr<state> next(new state(*_state));
+                next->sealed.erase(next->sealed.begin());
+                if( next->levels.empty() )
+                {
+                    next->levels.resize(1);
+                }
+                next->levels[0].push_back(r);
+                _stored += r->entries.size();
+                _state = next;
+            }
+            else
+            {
+                std::vector<run_ptr> runs(s->levels[l].rbegin(), s->levels[l].rend());
+                bool bottom = l + 1 >= s->levels.size() || s->levels[l+1].empty();
+                for(size_t d = l + 2; bottom && d < s->levels.size(); ++d)
+                {
+                    bottom = s->levels[d].empty();
+                }
+                lock.unlock();
+
+                run_ptr r = merge_runs(runs, bottom);
+
+                lock.lock();
+                std::shared_ptr<state> next(new state(*_state));
+                next->levels[l].clear();
+                if( next->levels.size() == l + 1 )
+                {
+                    next->levels.resize(l + 2);
+                }
+                next->levels[l+1].push_back(r);
+                _stored += r->entries.size();
+                _state = next;
+            }
+        }
+    }
+
+    template<typename K, typename V>
+    typename lsm_map<K, V>::run_ptr lsm_map<K, V>::merge_runs(const std::vector<run_ptr>& runs, bool bottom) const
+    {
+        // merge neighbours pairwise, the newer one first, so that the first
+        // of equal keys is the latest write
+        std::vector<entry_v> parts;
+        for(size_t i = 0; i < runs.size(); ++i)
+        {
+            parts.push_back(runs[i]->entries);
+        }
+
+        while( parts.size() > 1 )
+        {
+            std::vector<entry_v> merged;
+            for(size_t i = 0; i + 1 < parts.size(); i += 2)
+            {
+                entry_v out;
+                out.reserve(parts[i].size() + parts[i+1].size());
+                algo::merge(parts[i].begin(), parts[i].end(), parts[i+1].begin(), parts[i+1].end(), std::back_inserter(out));
+
+                size_t unique = 0;
+                for(size_t j = 0; j < out.size(); ++j)
+                {
+                    if( unique && !(out[unique-1] < out[j]) )
+                    {
+                        continue;
+                    }
+                    out[unique++] = out[j];
+                }
+                out.resize(unique);
+                merged.push_back(entry_v());
+                merged.back().swap(out);
+            }
+            if( parts.size() % 2 )
+            {
+                merged.push_back(entry_v());
+                merged.back().swap(parts.back());
+            }
+            parts.swap(merged);
+        }
+
+        entry_v& result = parts[0];
+        if( bottom )
+        {
+            size_t live = 0;
+            for(size_t i = 0; i < result.size(); ++i)
+            {
+                if( !result[i].erased )
+                {
+                    result[live++] = result[i];
+                }
+            }
+            result.resize(live);
+        }
+        return run_ptr(new run(result, _filter_bits));
+    }
+}
+
+#endif
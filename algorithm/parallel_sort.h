@@ -0,0 +1,232 @@
+#ifndef PARALLEL_SORT_H
+#define PARALLEL_SORT_H
+
+#include <vector>
+#include <thread>
+#include <iterator>
+
+#include "algorithm.h"
+#include "task_scheduler.h"
+
+namespace algo
+{
+    // Merges [first1, last1) and [first2, last2) into result like move_merge().
+    // The longer range is cut at its middle element and the other one at the
+    // position of that element, upper halves are merged by tasks, until
+    // pieces are down to grain elements. Equal elements of the first range
+    // come first, as with move_merge().
+    template<
+        typename InputIterator,
+        typename OutputIterator,
+        typename Predicator>
+    void _parallel_merge(task_scheduler& s,      size_t         worker,
+                         InputIterator   first1, InputIterator  last1,
+                         InputIterator   first2, InputIterator  last2,
+                         OutputIterator  result, Predicator     pred,
+                         size_t          grain)
+    {
+        task_scheduler::task_group g;
+        while( size_t((last1 - first1) + (last2 - first2)) > grain )
+        {
+            InputIterator mid1, mid2;
+            if( last1 - first1 >= last2 - first2 )
+            {
+                mid1 = first1 + (last1 - first1) / 2;
+                mid2 = algo::lower_bound(first2, last2, *mid1, pred);
+            }
+            else
+            {
+                mid2 = first2 + (last2 - first2) / 2;
+                mid1 = algo::upper_bound(first1, last1, *mid2, pred);
+            }
+
+            OutputIterator upper = result + (mid1 - first1) + (mid2 - first2);
+            s.spawn(worker, g, [=, &s](size_t w)
+            {
+                algo::_parallel_merge(s, w, mid1, last1, mid2, last2, upper, pred, grain);
+            });
+            last1 = mid1;
+            last2 = mid2;
+        }
+
+        algo::move_merge(first1, last1, first2, last2, result, pred);
+        s.wait(worker, g);
+    }
+
+    // Sorts [first, last) into [first, last), or into the buffer if
+    // into_buffer, using the other one as scratch space. Halves are sorted by
+    // a task and the calling worker into the other range and merged back.
+    // Ranges of grain elements are sorted by merge_sort if stable, by
+    // quick_sort otherwise.
+    template<
+        typename RandomAccessIterator,
+        typename BufferIterator,
+        typename Predicator>
+    void _parallel_merge_sort(task_scheduler&      s,      size_t               worker,
+                              RandomAccessIterator first,  RandomAccessIterator last,
+                              BufferIterator       buffer, bool                 into_buffer,
+                              Predicator           pred,   size_t               grain,
+                              bool                 stable)
+    {
+        size_t count = last - first;
+        if( count <= grain )
+        {
+            if( stable )
+            {
+                algo::merge_sort(first, last, buffer, pred);
+            }
+            else
+            {
+                algo::quick_sort(first, last, pred);
+            }
+
+            for(size_t i = 0; into_buffer && i < count; ++i)
+            {
+                *(buffer+i) = std::move(*(first+i));
+            }
+            return;
+        }
+
+        size_t half = count / 2;
+        task_scheduler::task_group g;
+        s.spawn(worker, g, [=, &s](size_t w)
+        {
+            algo::_parallel_merge_sort(s, w, first + half, last, buffer + half, !into_buffer, pred, grain, stable);
+        });
+        algo::_parallel_merge_sort(s, worker, first, first + half, buffer, !into_buffer, pred, grain, stable);
+        s.wait(worker, g);
+
+        if( into_buffer )
+        {
+            algo::_parallel_merge(s, worker, first, first + half, first + half, last, buffer, pred, grain);
+        }
+        else
+        {
+            algo::_parallel_merge(s, worker, buffer, buffer + half, buffer + half, buffer + count, first, pred, grain);
+        }
+    }
+
+    // number of elements sorted or merged by a single task, about 8 tasks
+    // per worker and level leave room for stealing
+    inline size_t _parallel_sort_grain(size_t count, size_t workers)
+    {
+        size_t grain = count / (workers * 8);
+        return grain < 4096 ? 4096 : grain;
+    }
+
+    // number of workers of task_scheduler(threads)
+    inline size_t _parallel_sort_workers(size_t threads)
+    {
+        if( !threads )
+        {
+            threads = std::thread::hardware_concurrency();
+        }
+        return threads ? threads : 1;
+    }
+
+    // Sorts elements in range [first, last) into ascending order on the
+    // workers of s, called by the thread owning s. Not stable.
+    // pred: predicator that defines a strict weak ordering
+    // A parallel merge sort over quick sorted pieces. The elements are moved
+    // to a buffer first and sorted back into [first, last).
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void parallel_sort(task_scheduler&      s,
+                       RandomAccessIterator first,
+                       RandomAccessIterator last,
+                       Predicator           pred)
+    {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+
+        size_t count = last - first;
+        size_t grain = algo::_parallel_sort_grain(count, s.workers());
+        if( count <= grain )
+        {
+            algo::quick_sort(first, last, pred);
+            return;
+        }
+
+        std::vector<value_type> buffer(std::make_move_iterator(first), std::make_move_iterator(last));
+        algo::_parallel_merge_sort(s, 0, buffer.begin(), buffer.end(), first, true, pred, grain, false);
+    }
+
+    // Sorts like above on the given number of threads, 0 for one per hardware
+    // thread. No thread is started for ranges too small to share out.
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void parallel_sort(RandomAccessIterator first,
+                       RandomAccessIterator last,
+                       Predicator           pred,
+                       size_t               threads = 0)
+    {
+        size_t count = last - first;
+        if( count <= algo::_parallel_sort_grain(count, algo::_parallel_sort_workers(threads)) )
+        {
+            algo::quick_sort(first, last, pred);
+            return;
+        }
+
+        task_scheduler s(threads);
+        algo::parallel_sort(s, first, last, pred);
+    }
+
+    template<typename RandomAccessIterator>
+    void parallel_sort(RandomAccessIterator first, RandomAccessIterator last)
+    {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+        algo::parallel_sort(first, last, algo::less<value_type>());
+    }
+
+    // Stable sort of elements in range [first, last) like merge_sort, on the
+    // workers of s, called by the thread owning s.
+    // buffer: Buffer of at least last-first elements
+    // pred:   predicator that defines a strict weak ordering
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void parallel_merge_sort(task_scheduler&      s,
+                             RandomAccessIterator first,
+                             RandomAccessIterator last,
+                             RandomAccessIterator buffer,
+                             Predicator           pred)
+    {
+        size_t count = last - first;
+        size_t grain = algo::_parallel_sort_grain(count, s.workers());
+        algo::_parallel_merge_sort(s, 0, first, last, buffer, false, pred, grain, true);
+    }
+
+    // Stable sort like above on the given number of threads, 0 for one per
+    // hardware thread. No thread is started for ranges too small to share out.
+    template<
+        typename RandomAccessIterator,
+        typename Predicator>
+    void parallel_merge_sort(RandomAccessIterator first,
+                             RandomAccessIterator last,
+                             RandomAccessIterator buffer,
+                             Predicator           pred,
+                             size_t               threads = 0)
+    {
+        size_t count = last - first;
+        if( count <= algo::_parallel_sort_grain(count, algo::_parallel_sort_workers(threads)) )
+        {
+            algo::merge_sort(first, last, buffer, pred);
+            return;
+        }
+
+        task_scheduler s(threads);
+        algo::parallel_merge_sort(s, first, last, buffer, pred);
+    }
+
+    template<typename RandomAccessIterator>
+    void parallel_merge_sort(RandomAccessIterator first,
+                             RandomAccessIterator last,
+                             RandomAccessIterator buffer)
+    {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+        algo::parallel_merge_sort(first, last, buffer, algo::less<value_type>());
+    }
+}
+
+#endif
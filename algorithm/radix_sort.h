@@ -0,0 +1,276 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+#include "algorithm.h"
+
+namespace algo
+{
+    // Maps keys to unsigned integers of the same width, in the same order.
+    // Signed integers have their sign bit flipped. Negative floating point
+    // numbers have all bits flipped, others their sign bit only.
+    template<typename T, bool Float = std::is_floating_point<T>::value>
+    class radix_traits
+    {
+    public:
+        typedef typename std::make_unsigned<T>::type bits_type;
+
+        static bits_type bits(T v)
+        {
+            bits_type sign = std::numeric_limits<T>::is_signed ? bits_type(1) << (sizeof(T) * 8 - 1) : 0;
+            return bits_type(v) ^ sign;
+        }
+    };
+
+    template<typename T>
+    class radix_traits<T, true>
+    {
+    public:
+        typedef typename std::conditional<sizeof(T) == 4, unsigned int, unsigned long long>::type bits_type;
+
+        static bits_type bits(T v)
+        {
+            static_assert(sizeof(T) == sizeof(bits_type), "radix_traits supports float and double only");
+
+            bits_type b;
+            std::memcpy(&b, &v, sizeof(T));
+            bits_type sign = bits_type(1) << (sizeof(T) * 8 - 1);
+            return (b & sign) ? ~b : b ^ sign;
+        }
+    };
+
+    // Default key extractor, elements are keys
+    template<typename T>
+    class radix_identity
+    {
+    public:
+        const T& operator() (const T& v) const { return v; }
+    };
+
+    // Orders elements by their keys, for the short ranges of radix_sort_in_place
+    template<typename Traits, typename KeyOf>
+    class _radix_less
+    {
+    public:
+        explicit _radix_less(KeyOf key): _key(key) {}
+
+        template<typename T>
+        bool operator() (const T& t1, const T& t2) const
+        {
+            return Traits::bits(_key(t1)) < Traits::bits(_key(t2));
+        }
+
+    private:
+        KeyOf _key;
+    };
+
+    // One pass of radix_sort, moves count elements from src to dst by the
+    // digit at shift. offsets are the starts of the buckets in dst.
+    template<
+        typename Traits,
+        typename InputIterator,
+        typename OutputIterator,
+        typename KeyOf>
+    void _radix_scatter(InputIterator  src,     size_t  count,
+                        OutputIterator dst,     size_t* offsets,
+                        size_t         shift,   KeyOf&  key)
+    {
+        for(size_t i = 0; i < count; ++i, ++src)
+        {
+            size_t digit = size_t(Traits::bits(key(*src)) >> shift) & 255;
+            *(dst + offsets[digit]++) = std::move(*src);
+        }
+    }
+
+    // Sorts elements in range [first, last) into ascending order of their
+    // keys, stable. Least significant digit first, a byte per pass.
+    // buffer: Buffer of at least last-first elements
+    // key:    extracts the key of an element, an integer, float or double
+    // Digits are counted for all passes at once, passes over a digit shared
+    // by all keys are skipped.
+    template<
+        typename RandomAccessIterator,
+        typename BufferIterator,
+        typename KeyOf>
+    void radix_sort(RandomAccessIterator first,
+                    RandomAccessIterator last,
+                    BufferIterator       buffer,
+                    KeyOf                key)
+    {
+        typedef typename std::decay<decltype(key(*first))>::type key_type;
+        typedef radix_traits<key_type>                          traits;
+        typedef typename traits::bits_type                      bits_type;
+
+        size_t count = last - first;
+        if( last < first || count < 2 )
+        {
+            return;
+        }
+
+        enum { digits = sizeof(bits_type) };
+        std::vector<size_t> counts(digits * 256, 0);
+        for(RandomAccessIterator it = first; it != last; ++it)
+        {
+            bits_type b = traits::bits(key(*it));
+            for(size_t d = 0; d < digits; ++d)
+            {
+                ++counts[d * 256 + (size_t(b >> (d * 8)) & 255)];
+            }
+        }
+
+        bool in_buffer = false;
+        for(size_t d = 0; d < digits; ++d)
+        {
+            size_t* offsets = &counts[d * 256];
+            size_t  shift   = d * 8;
+
+            // all keys have the same digit, the pass would not move anything
+            bits_type sample = in_buffer ? traits::bits(key(*buffer)) : traits::bits(key(*first));
+            if( offsets[size_t(sample >> shift) & 255] == count )
+            {
+                continue;
+            }
+
+            for(size_t i = 0, sum = 0; i < 256; ++i)
+            {
+                size_t n = offsets[i];
+                offsets[i] = sum;
+                sum += n;
+            }
+
+            if( in_buffer )
+            {
+                algo::_radix_scatter<traits>(buffer, count, first, offsets, shift, key);
+            }
+            else
+            {
+                algo::_radix_scatter<traits>(first, count, buffer, offsets, shift, key);
+            }
+            in_buffer = !in_buffer;
+        }
+
+        for(size_t i = 0; in_buffer && i < count; ++i)
+        {
+            *(first+i) = std::move(*(buffer+i));
+        }
+    }
+
+    template<
+        typename RandomAccessIterator,
+        typename BufferIterator>
+    void radix_sort(RandomAccessIterator first,
+                    RandomAccessIterator last,
+                    BufferIterator       buffer)
+    {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+        algo::radix_sort(first, last, buffer, algo::radix_identity<value_type>());
+    }
+
+    // American flag sort of [first, last) by the digit at shift and the less
+    // significant ones
+    template<
+        typename Traits,
+        typename RandomAccessIterator,
+        typename KeyOf>
+    void _radix_sort_msd(RandomAccessIterator first,
+                         RandomAccessIterator last,
+                         size_t               shift,
+                         KeyOf&               key)
+    {
+        enum { cutoff = 64 }; // ranges up to this long are sorted by comparison
+
+        size_t count = last - first;
+        if( count <= cutoff )
+        {
+            algo::quick_sort(first, last, _radix_less<Traits, KeyOf>(key));
+            return;
+        }
+
+        size_t counts[256] = { 0 };
+        for(RandomAccessIterator it = first; it != last; ++it)
+        {
+            ++counts[size_t(Traits::bits(key(*it)) >> shift) & 255];
+        }
+
+        // all keys have the same digit, go on with the next one
+        size_t sample = size_t(Traits::bits(key(*first)) >> shift) & 255;
+        if( counts[sample] == count )
+        {
+            if( shift )
+            {
+                algo::_radix_sort_msd<Traits>(first, last, shift - 8, key);
+            }
+            return;
+        }
+
+        size_t heads[256], tails[256];
+        for(size_t i = 0, sum = 0; i < 256; ++i)
+        {
+            heads[i] = sum;
+            sum += counts[i];
+            tails[i] = sum;
+        }
+
+        // Swap elements into their buckets, every swap puts one element at
+        // the head of its bucket for good
+        for(size_t b = 0; b < 256; ++b)
+        {
+            while( heads[b] < tails[b] )
+            {
+                size_t digit = size_t(Traits::bits(key(*(first + heads[b]))) >> shift) & 255;
+                if( digit == b )
+                {
+                    ++heads[b];
+                }
+                else
+                {
+                    algo::swap(*(first + heads[b]), *(first + heads[digit]));
+                    ++heads[digit];
+                }
+            }
+        }
+
+        for(size_t b = 0, start = 0; shift && b < 256; start = tails[b++])
+        {
+            if( tails[b] - start > 1 )
+            {
+                algo::_radix_sort_msd<Traits>(first + start, first + tails[b], shift - 8, key);
+            }
+        }
+    }
+
+    // Sorts elements in range [first, last) into ascending order of their
+    // keys in place, not stable. Most significant digit first, a byte at a
+    // time, short ranges are sorted by quick_sort.
+    // key: extracts the key of an element, an integer, float or double
+    template<
+        typename RandomAccessIterator,
+        typename KeyOf>
+    void radix_sort_in_place(RandomAccessIterator first,
+                             RandomAccessIterator last,
+                             KeyOf                key)
+    {
+        typedef typename std::decay<decltype(key(*first))>::type key_type;
+        typedef radix_traits<key_type>                          traits;
+
+        if( last - first < 2 )
+        {
+            return;
+        }
+        algo::_radix_sort_msd<traits>(first, last, (sizeof(key_type) - 1) * 8, key);
+    }
+
+    template<typename RandomAccessIterator>
+    void radix_sort_in_place(RandomAccessIterator first, RandomAccessIterator last)
+    {
+        typedef typename std::iterator_traits<RandomAccessIterator>::value_type value_type;
+        algo::radix_sort_in_place(first, last, algo::radix_identity<value_type>());
+    }
+}
+
+#endif
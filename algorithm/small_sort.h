@@ -0,0 +1,340 @@
+#ifndef SMALL_SORT_H
+#define SMALL_SORT_H
+
+#include "algorithm.h"
+
+#include <limits>
+#if ALGO_SORTING_NETWORKS
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Functions using AVX2 instructions, called only once the processor is known
+// to have them. GCC and Clang compile them for AVX2 without enabling it for
+// the whole program.
+#if defined(__GNUC__) || defined(__clang__)
+#define ALGO_AVX2 __attribute__((target("avx2")))
+#else
+#define ALGO_AVX2
+#endif
+
+namespace algo
+{
+#if ALGO_SORTING_NETWORKS
+    namespace _avx2
+    {
+        inline bool cpu_has_avx2()
+        {
+#if defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if( info[0] < 7 )
+            {
+                return false;
+            }
+
+            // AVX, and the OS saving the AVX registers
+            __cpuid(info, 1);
+            if( (info[2] & (1 << 28)) == 0 || (info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6 )
+            {
+                return false;
+            }
+
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__)
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") != 0;
+#else
+            return false;
+#endif
+        }
+
+        // Found out once, before main(). Until then it reads false, so
+        // sorts run by static initializers take the scalar path.
+        template<typename T>
+        class cpu
+        {
+        public:
+            static const bool has_avx2;
+        };
+
+        template<typename T>
+        const bool cpu<T>::has_avx2 = cpu_has_avx2();
+
+        // Element types in AVX2 registers, width is the number of 32-bit parts of
+        // an element. min(a, b) and max(a, b) of floating point elements pick
+        // by a single comparison, so one gets a and the other b if they are
+        // equal, and of -0.0 and 0.0 both are kept.
+        class avx2_int
+        {
+        public:
+            typedef int     value_type;
+            typedef __m256i reg;
+            enum { lanes = 8, width = 1 };
+
+            static value_type sentinel() { return std::numeric_limits<value_type>::max(); }
+
+            static ALGO_AVX2 reg load(const value_type* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+            static ALGO_AVX2 void store(value_type* p, reg v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+            static ALGO_AVX2 reg min(reg a, reg b) { return _mm256_min_epi32(a, b); }
+            static ALGO_AVX2 reg max(reg a, reg b) { return _mm256_max_epi32(a, b); }
+            static ALGO_AVX2 reg permute(reg v, __m256i index) { return _mm256_permutevar8x32_epi32(v, index); }
+            static ALGO_AVX2 reg blend(reg a, reg b, __m256i mask) { return _mm256_blendv_epi8(a, b, mask); }
+        };
+
+        class avx2_long_long
+        {
+        public:
+            typedef long long value_type;
+            typedef __m256i   reg;
+            enum { lanes = 4, width = 2 };
+
+            static value_type sentinel() { return std::numeric_limits<value_type>::max(); }
+
+            static ALGO_AVX2 reg load(const value_type* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+            static ALGO_AVX2 void store(value_type* p, reg v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+            static ALGO_AVX2 reg min(reg a, reg b) { return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b)); }
+            static ALGO_AVX2 reg max(reg a, reg b) { return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b)); }
+            static ALGO_AVX2 reg permute(reg v, __m256i index) { return _mm256_permutevar8x32_epi32(v, index); }
+            static ALGO_AVX2 reg blend(reg a, reg b, __m256i mask) { return _mm256_blendv_epi8(a, b, mask); }
+        };
+
+        class avx2_float
+        {
+        public:
+            typedef float  value_type;
+            typedef __m256 reg;
+            enum { lanes = 8, width = 1 };
+
+            static value_type sentinel() { return std::numeric_limits<value_type>::infinity(); }
+
+            static ALGO_AVX2 reg load(const value_type* p) { return _mm256_loadu_ps(p); }
+            static ALGO_AVX2 void store(value_type* p, reg v) { _mm256_storeu_ps(p, v); }
+            static ALGO_AVX2 reg min(reg a, reg b) { return _mm256_blendv_ps(a, b, _mm256_cmp_ps(b, a, _CMP_LT_OQ)); }
+            static ALGO_AVX2 reg max(reg a, reg b) { return _mm256_blendv_ps(b, a, _mm256_cmp_ps(b, a, _CMP_LT_OQ)); }
+            static ALGO_AVX2 reg permute(reg v, __m256i index) { return _mm256_permutevar8x32_ps(v, index); }
+            static ALGO_AVX2 reg blend(reg a, reg b, __m256i mask) { return _mm256_blendv_ps(a, b, _mm256_castsi256_ps(mask)); }
+        };
+
+        class avx2_double
+        {
+        public:
+            typedef double  value_type;
+            typedef __m256d reg;
+            enum { lanes = 4, width = 2 };
+
+            static value_type sentinel() { return std::numeric_limits<value_type>::infinity(); }
+
+            static ALGO_AVX2 reg load(const value_type* p) { return _mm256_loadu_pd(p); }
+            static ALGO_AVX2 void store(value_type* p, reg v) { _mm256_storeu_pd(p, v); }
+            static ALGO_AVX2 reg min(reg a, reg b) { return _mm256_blendv_pd(a, b, _mm256_cmp_pd(b, a, _CMP_LT_OQ)); }
+            static ALGO_AVX2 reg max(reg a, reg b) { return _mm256_blendv_pd(b, a, _mm256_cmp_pd(b, a, _CMP_LT_OQ)); }
+            static ALGO_AVX2 reg blend(reg a, reg b, __m256i mask) { return _mm256_blendv_pd(a, b, _mm256_castsi256_pd(mask)); }
+
+            static ALGO_AVX2 reg permute(reg v, __m256i index)
+            {
+                return _mm256_castsi256_pd(_mm256_permutevar8x32_epi32(_mm256_castpd_si256(v), index));
+            }
+        };
+
+        // Compare-exchange of every lane i with lane i ^ x, lanes with i & bit
+        // set keep the greater element. Both lanes of a pair compare in the same
+        // order, so that for equal elements they pick different ones.
+        template<typename Ops>
+        ALGO_AVX2 inline typename Ops::reg exchange(typename Ops::reg v, int x, int bit)
+        {
+            __m256i parts = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            __m256i index = _mm256_xor_si256(parts, _mm256_set1_epi32(x * Ops::width));
+            __m256i upper = _mm256_set1_epi32(bit * Ops::width);
+            __m256i mask  = _mm256_cmpeq_epi32(_mm256_and_si256(parts, upper), upper);
+
+            typename Ops::reg p = Ops::permute(v, index);
+            return Ops::blend(Ops::min(v, p), Ops::max(p, v), mask);
+        }
+
+        template<typename Ops>
+        ALGO_AVX2 inline typename Ops::reg reverse(typename Ops::reg v)
+        {
+            __m256i parts = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            return Ops::permute(v, _mm256_xor_si256(parts, _mm256_set1_epi32((Ops::lanes - 1) * Ops::width)));
+        }
+
+        // Bitonic sort of the lanes of a register. Merging two sorted blocks of
+        // lanes compares each lane with its mirror in the other block first, then
+        // halves as usual.
+        template<typename Ops>
+        ALGO_AVX2 inline typename Ops::reg sort_lanes(typename Ops::reg v)
+        {
+            for(int block = 2; block <= Ops::lanes; block *= 2)
+            {
+                v = exchange<Ops>(v, block - 1, block / 2);
+                for(int d = block / 4; d; d /= 2)
+                {
+                    v = exchange<Ops>(v, d, d);
+                }
+            }
+            return v;
+        }
+
+        // Sorts the lanes of a register that hold a bitonic sequence
+        template<typename Ops>
+        ALGO_AVX2 inline typename Ops::reg merge_lanes(typename Ops::reg v)
+        {
+            for(int d = Ops::lanes / 2; d; d /= 2)
+            {
+                v = exchange<Ops>(v, d, d);
+            }
+            return v;
+        }
+
+        // Sorts up to small_sort_max elements in registers. The elements are
+        // padded with sentinels to a power of 2 of registers, every register is
+        // sorted, then blocks of sorted registers are merged pairwise by bitonic
+        // merges: registers are compared with their mirrors in the other block,
+        // then with those half as far apart, down to the lanes of each register.
+        template<typename Ops>
+        ALGO_AVX2 void network_sort(typename Ops::value_type* first, typename Ops::value_type* last)
+        {
+            typedef typename Ops::value_type value_type;
+            typedef typename Ops::reg        reg;
+            enum { lanes = Ops::lanes, max_regs = algo::small_sort_max / Ops::lanes };
+
+            size_t count = last - first;
+            size_t regs  = 1;
+            while( regs * lanes < count )
+            {
+                regs *= 2;
+            }
+
+            value_type padded[algo::small_sort_max];
+            for(size_t i = 0; i < regs * lanes; ++i)
+            {
+                padded[i] = i < count ? first[i] : Ops::sentinel();
+            }
+
+            reg v[max_regs];
+            for(size_t r = 0; r < regs; ++r)
+            {
+                v[r] = sort_lanes<Ops>(Ops::load(padded + r * lanes));
+            }
+
+            for(size_t s = 1; s < regs; s *= 2)
+            {
+                for(size_t a = 0; a < regs; a += 2 * s)
+                {
+                    for(size_t j = 0; j < s; ++j)
+                    {
+                        reg mirror = reverse<Ops>(v[a + 2 * s - 1 - j]);
+                        v[a + 2 * s - 1 - j] = reverse<Ops>(Ops::max(v[a + j], mirror));
+                        v[a + j] = Ops::min(v[a + j], mirror);
+                    }
+
+                    for(size_t d = s / 2; d; d /= 2)
+                    {
+                        for(size_t x = a; x < a + 2 * s; ++x)
+                        {
+                            if( !((x - a) & d) )
+                            {
+                                reg lower = Ops::min(v[x], v[x + d]);
+                                v[x + d]  = Ops::max(v[x], v[x + d]);
+                                v[x]      = lower;
+                            }
+                        }
+                    }
+
+                    for(size_t x = a; x < a + 2 * s; ++x)
+                    {
+                        v[x] = merge_lanes<Ops>(v[x]);
+                    }
+                }
+            }
+
+            for(size_t r = 0; r < regs; ++r)
+            {
+                Ops::store(padded + r * lanes, v[r]);
+            }
+            for(size_t i = 0; i < count; ++i)
+            {
+                first[i] = padded[i];
+            }
+        }
+
+        // NaN is unordered, networks would mix it up with the padding
+        template<typename T>
+        bool has_unordered(const T* first, const T* last)
+        {
+            for(; first != last; ++first)
+            {
+                if( !(*first == *first) )
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        template<typename Ops>
+        void sort(typename Ops::value_type* first, typename Ops::value_type* last)
+        {
+            typedef typename Ops::value_type value_type;
+
+            if( last - first > algo::small_sort_max )
+            {
+                algo::quick_sort(first, last);
+            }
+            else if( cpu<void>::has_avx2 && last - first > 1 && !has_unordered(first, last) )
+            {
+                network_sort<Ops>(first, last);
+            }
+            else
+            {
+                algo::_insertion_sort(first, last, algo::less<value_type>());
+            }
+        }
+    }
+
+    inline void small_sort(int* first, int* last)
+    {
+        _avx2::sort<_avx2::avx2_int>(first, last);
+    }
+
+    inline void small_sort(long long* first, long long* last)
+    {
+        _avx2::sort<_avx2::avx2_long_long>(first, last);
+    }
+
+    inline void small_sort(float* first, float* last)
+    {
+        _avx2::sort<_avx2::avx2_float>(first, last);
+    }
+
+    inline void small_sort(double* first, double* last)
+    {
+        _avx2::sort<_avx2::avx2_double>(first, last);
+    }
+#else
+    // no sorting networks off x86, short ranges are insertion sorted
+    template<typename T>
+    void _scalar_small_sort(T* first, T* last)
+    {
+        if( last - first > algo::small_sort_max )
+        {
+            algo::quick_sort(first, last);
+        }
+        else
+        {
+            algo::_insertion_sort(first, last, algo::less<T>());
+        }
+    }
+
+    inline void small_sort(int* first, int* last)             { algo::_scalar_small_sort(first, last); }
+    inline void small_sort(long long* first, long long* last) { algo::_scalar_small_sort(first, last); }
+    inline void small_sort(float* first, float* last)         { algo::_scalar_small_sort(first, last); }
+    inline void small_sort(double* first, double* last)       { algo::_scalar_small_sort(first, last); }
+#endif
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include "task_scheduler.h"
+using namespace algo;
+
+
+algo::task_scheduler::task_scheduler(size_t threads)
+    : _queued(0), _stop(false)
+{
+    if( !threads )
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    if( !threads )
+    {
+        threads = 1;
+    }
+
+    for(size_t i = 0; i < threads; ++i)
+    {
+        _queues.push_back(std::unique_ptr<queue>(new queue()));
+    }
+
+    // worker 0 is the owning thread
+    for(size_t i = 1; i < threads; ++i)
+    {
+        _threads.push_back(std::thread(&task_scheduler::_work, this, i));
+    }
+}
+
+algo::task_scheduler::~task_scheduler()
+{
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+
+    for(size_t i = 0; i < _threads.size(); ++i)
+    {
+        _threads[i].join();
+    }
+}
+
+void algo::task_scheduler::spawn(size_t worker, task_group& g, const task& fn)
+{
+    ++g._pending;
+    {
+        queue& q = *_queues[worker];
+        std::lock_guard<std::mutex> guard(q.mutex);
+        q.tasks.push_back(entry(fn, &g));
+    }
+    ++_queued;
+
+    // an idle worker checks _queued holding _mutex, so it either sees the
+    // task or is already waiting to be woken
+    {
+        std::lock_guard<std::mutex> guard(_mutex);
+    }
+    _wake.notify_one();
+}
+
+void algo::task_scheduler::wait(size_t worker, task_group& g)
+{
+    while( g._pending )
+    {
+        if( !_run_one(worker) )
+        {
+            // the remaining tasks of g are running on other workers
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool algo::task_scheduler::_run_one(size_t worker)
+{
+    entry e;
+    size_t count = _queues.size();
+    for(size_t i = 0; i < count && !e.group; ++i)
+    {
+        queue& q = *_queues[(worker + i) % count];
+        std::lock_guard<std::mutex> guard(q.mutex);
+        if( q.tasks.empty() )
+        {
+            continue;
+        }
+
+        // own tasks are taken newest first, stolen ones oldest first
+        if( i == 0 )
+        {
+            e = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        }
+        else
+        {
+            e = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+    }
+
+    if( !e.group )
+    {
+        return false;
+    }
+
+    --_queued;
+    e.fn(worker);
+    --e.group->_pending;
+    return true;
+}
+
+void algo::task_scheduler::_work(size_t worker)
+{
+    for(;;)
+    {
+        if( _run_one(worker) )
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        while( !_stop && !_queued )
+        {
+            _wake.wait(lock);
+        }
+        if( _stop )
+        {
+            return;
+        }
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <deque>
+#include <utility>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace algo
+{
+    // Fork-join thread pool with work stealing.
+    // Every worker owns a deque of tasks. It pushes and pops its own tasks at
+    // the back, thus runs the most recent, smallest subproblem first, while
+    // idle workers steal from the front of other deques, taking the oldest,
+    // largest subproblems. Worker 0 is the thread owning the scheduler, it
+    // joins the work while waiting for a group of tasks.
+    // A task is given the index of the worker running it, to spawn subtasks
+    // onto the deque of that worker.
+    class task_scheduler
+    {
+    public:
+        typedef std::function<void(size_t)> task;
+
+        // tasks waited for together
+        class task_group
+        {
+        public:
+            task_group(): _pending(0) {}
+
+        private:
+            friend class task_scheduler;
+
+            std::atomic<size_t> _pending;
+        };
+
+        // Creates a scheduler of the given number of workers, the calling
+        // thread included. 0 means one worker per hardware thread.
+        explicit task_scheduler(size_t threads = 0);
+        ~task_scheduler();
+
+        size_t workers() const { return _queues.size(); }
+
+        // queue fn as part of group g, worker is the worker calling spawn
+        void spawn(size_t worker, task_group& g, const task& fn);
+
+        // run queued tasks until those of group g are done, worker is the
+        // worker calling wait
+        void wait(size_t worker, task_group& g);
+
+    private:
+        class entry
+        {
+        public:
+            entry(): group(nullptr) {}
+            entry(const task& t, task_group* g): fn(t), group(g) {}
+
+            task        fn;
+            task_group* group;
+        };
+
+        class queue
+        {
+        public:
+            std::mutex        mutex;
+            std::deque<entry> tasks;
+        };
+
+        // run a task of worker, or one stolen from another worker, returns
+        // false if all deques are empty
+        bool _run_one(size_t worker);
+
+        // loop of a worker thread
+        void _work(size_t worker);
+
+        std::vector<std::unique_ptr<queue> > _queues;
+        std::vector<std::thread>             _threads;
+        std::atomic<size_t>                  _queued;  // tasks in all deques
+
+        std::mutex                           _mutex;   // guards _stop, idle workers sleep on it
+        std::condition_variable              _wake;
+        bool                                 _stop;
+    };
+}
+
+#endif
@@ -3,12 +3,27 @@
 #include "slist.h"
 #include "disjoint_set.h"
 #include "linear_select.h"
+#include "lsm_map.h"
+#include "parallel_sort.h"
+#include "radix_sort.h"
+#include "eytzinger_index.h"
+#include "external_sort.h"
+#include "loser_tree.h"
 
 #include <random>
 #include <algorithm>
 #include <ctime>
 #include <iostream>
 #include <vector>
+#include <iterator>
+#include <map>
+#include <functional>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <thread>
 
 class reversed_less
 {
@@ -49,6 +64,22 @@ size_t quick_sort_pred_test(const std::vector<int>& input, const std::vector<int
     return s == expected ? 0 : 1;
 }
 
+// counts comparisons, to check the bound on the worst case
+class counting_less
+{
+public:
+    counting_less(size_t& count): _count(count) {}
+
+    bool operator() (int t1, int t2) const
+    {
+        ++_count;
+        return t1 < t2;
+    }
+
+private:
+    size_t& _count;
+};
+
 size_t heap_sort_test(const std::vector<int>& input, const std::vector<int>& expected)
 {
     std::vector<int> s(input);
@@ -154,6 +185,472 @@ void CASE_sort_random()
     }
 }
 
+void CASE_sort_patterns()
+{
+    const int n = 100000;
+    size_t log_n = 0;
+    for (int m = n; m > 1; m /= 2)
+    {
+        ++log_n;
+    }
+
+    size_t failures = 0;
+    size_t worst = 0;
+    for (int pattern = 0; pattern < 7; ++pattern)
+    {
+        std::vector<int> input(n);
+        for (int i = 0; i < n; ++i)
+        {
+            switch (pattern)
+            {
+            case 0: input[i] = i; break;                          // sorted
+            case 1: input[i] = n - i; break;                      // reversed
+            case 2: input[i] = 7; break;                          // all equal
+            case 3: input[i] = i % 4; break;                      // few distinct
+            case 4: input[i] = i < n / 2 ? i : n - i; break;      // organ pipe
+            case 5: input[i] = i % 1000; break;                   // sawtooth
+            default: input[i] = std::rand() % 100; break;         // random duplicates
+            }
+        }
+
+        std::vector<int> expected(input);
+        std::sort(expected.begin(), expected.end());
+
+        size_t comparisons = 0;
+        algo::quick_sort(input.begin(), input.end(), counting_less(comparisons));
+        failures += input != expected;
+        worst = comparisons > worst ? comparisons : worst;
+    }
+
+    if (failures == 0 && worst < 4 * n * log_n)
+    {
+        std::cout << "CASE_sort_patterns: PASSED\n";
+    }
+    else
+    {
+        std::cout << "CASE_sort_patterns: FAILED!!!\n"
+            << "    quick_sort failure " << failures << '\n'
+            << "    comparisons " << worst << '\n';
+    }
+}
+
+// orders pairs by their first element only, to check stability
+class first_less
+{
+public:
+    bool operator() (const std::pair<int, int>& t1, const std::pair<int, int>& t2) const
+    {
+        return t1.first < t2.first;
+    }
+};
+
+void CASE_parallel_sort()
+{
+    const int n = 200000;
+    size_t failures = 0;
+    for (int pattern = 0; pattern < 3; ++pattern)
+    {
+        std::vector<int> input(n);
+        for (int i = 0; i < n; ++i)
+        {
+            switch (pattern)
+            {
+            case 0: input[i] = std::rand(); break;       // random
+            case 1: input[i] = i; break;                 // sorted
+            default: input[i] = std::rand() % 16; break; // few distinct
+            }
+        }
+
+        std::vector<int> expected(input);
+        std::sort(expected.begin(), expected.end());
+
+        for (size_t threads = 1; threads <= 4; threads *= 2)
+        {
+            std::vector<int> s(input);
+            algo::parallel_sort(s.begin(), s.end(), algo::less<int>(), threads);
+            failures += s != expected;
+        }
+    }
+
+    // equal keys keep their order
+    std::vector<std::pair<int, int> > pairs(n);
+    for (int i = 0; i < n; ++i)
+    {
+        pairs[i] = std::make_pair(std::rand() % 100, i);
+    }
+    std::vector<std::pair<int, int> > stable(pairs), buffer(n);
+    std::stable_sort(stable.begin(), stable.end(), first_less());
+    algo::parallel_merge_sort(pairs.begin(), pairs.end(), buffer.begin(), first_less(), 4);
+    failures += pairs != stable;
+
+    // a scheduler kept over sorts of all sizes
+    algo::task_scheduler shared(3);
+    for (int size = 10; size <= n; size *= 10)
+    {
+        std::vector<int> s(size);
+        for (int i = 0; i < size; ++i)
+        {
+            s[i] = std::rand();
+        }
+        std::vector<int> expected(s);
+        std::sort(expected.begin(), expected.end());
+        algo::parallel_sort(shared, s.begin(), s.end(), algo::less<int>());
+        failures += s != expected;
+    }
+
+    if (failures == 0)
+    {
+        std::cout << "CASE_parallel_sort: PASSED\n";
+    }
+    else
+    {
+        std::cout << "CASE_parallel_sort: FAILED!!!\n"
+            << "    parallel_sort failure " << failures << '\n';
+    }
+}
+
+void PERF_parallel_sort()
+{
+    // random, sorted and few distinct keys, std::sort against parallel_sort
+    // on schedulers made beforehand
+    const int n = 1 << 23;
+    const char* patterns[] = { "random", "sorted", "few distinct" };
+    std::cout << "PERF_parallel_sort: " << n << " ints, "
+        << std::thread::hardware_concurrency() << " hardware threads\n";
+
+    std::mt19937 gen(7);
+    for (int pattern = 0; pattern < 3; ++pattern)
+    {
+        std::vector<int> input(n);
+        for (int i = 0; i < n; ++i)
+        {
+            switch (pattern)
+            {
+            case 0: input[i] = int(gen() >> 1); break;
+            case 1: input[i] = i; break;
+            default: input[i] = int(gen() % 16); break;
+            }
+        }
+
+        std::vector<int> s(input);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::sort(s.begin(), s.end());
+        long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "    " << patterns[pattern] << ", std::sort: " << ms << " ms\n";
+
+        for (size_t threads = 1; threads <= 8; threads *= 2)
+        {
+            algo::task_scheduler scheduler(threads);
+            s = input;
+            start = std::chrono::steady_clock::now();
+            algo::parallel_sort(scheduler, s.begin(), s.end(), algo::less<int>());
+            ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "    " << patterns[pattern] << ", " << threads << " threads: " << ms << " ms\n";
+        }
+    }
+}
+
+template<typename T>
+size_t small_sort_test()
+{
+    size_t failures = 0;
+    for (int n = 0; n <= 80; ++n)
+    {
+        for (int t = 0; t < 20; ++t)
+        {
+            std::vector<T> input(n);
+            for (int i = 0; i < n; ++i)
+            {
+                input[i] = T(std::rand() % (t % 2 ? 8 : 100000) - 50);
+            }
+
+            std::vector<T> expected(input);
+            std::sort(expected.begin(), expected.end());
+
+            std::vector<T> s(input);
+            algo::small_sort(s.begin(), s.end());
+            failures += s != expected;
+
+            std::vector<T> p(input);
+            algo::small_sort(p.data(), p.data() + p.size());
+            failures += p != expected;
+        }
+    }
+    return failures;
+}
+
+void CASE_small_sort()
+{
+    size_t failures = small_sort_test<int>() + small_sort_test<long long>()
+        + small_sort_test<float>() + small_sort_test<double>();
+
+    // -0.0 and 0.0 are equal, but both stay
+    std::vector<float> zeros(40);
+    for (size_t i = 0; i < zeros.size(); ++i)
+    {
+        zeros[i] = i % 3 ? 0.0f : -0.0f;
+    }
+    algo::small_sort(zeros.begin(), zeros.end());
+    size_t negative = 0;
+    for (size_t i = 0; i < zeros.size(); ++i)
+    {
+        negative += std::signbit(zeros[i]) ? 1 : 0;
+        failures += zeros[i] != 0.0f;
+    }
+    failures += negative != 14;
+
+    // other types and orders are insertion sorted
+    std::vector<std::pair<int, int> > pairs(50);
+    for (size_t i = 0; i < pairs.size(); ++i)
+    {
+        pairs[i] = std::make_pair(std::rand() % 10, int(i));
+    }
+    std::vector<std::pair<int, int> > stable(pairs);
+    std::stable_sort(stable.begin(), stable.end(), first_less());
+    algo::small_sort(pairs.begin(), pairs.end(), first_less());
+    failures += pairs != stable;
+
+    std::cout << "CASE_small_sort: " << (failures == 0 ? "PASSED" : "FAILED!!!") << '\n';
+}
+
+void CASE_merge_sort_runs()
+{
+    size_t failures = 0;
+    for (int n = 0; n < 3000; n = n < 100 ? n + 1 : n * 3 / 2)
+    {
+        for (int pattern = 0; pattern < 6; ++pattern)
+        {
+            // second elements number equal keys in order
+            std::vector<std::pair<int, int> > input(n);
+            for (int i = 0; i < n; ++i)
+            {
+                switch (pattern)
+                {
+                case 0: input[i].first = i / 3; break;                  // sorted
+                case 1: input[i].first = (n - i) / 3; break;            // reversed
+                case 2: input[i].first = i < n / 2 ? i : n - i; break;  // organ pipe
+                case 3: input[i].first = i % 100; break;                // sawtooth
+                case 4: input[i].first = (i / 50) % 2 ? -i : i; break;  // alternating runs
+                default: input[i].first = std::rand() % 50; break;      // random
+                }
+                input[i].second = i;
+            }
+
+            std::vector<std::pair<int, int> > expected(input);
+            std::stable_sort(expected.begin(), expected.end(), first_less());
+
+            std::vector<std::pair<int, int> > buffer(n);
+            algo::merge_sort(input.begin(), input.end(), buffer.begin(), first_less());
+            failures += input != expected;
+        }
+    }
+
+    // sorted and nearly sorted input take about a comparison per element
+    const int n = 100000;
+    size_t comparisons = 0;
+    std::vector<int> s(n), buffer(n);
+    for (int i = 0; i < n; ++i)
+    {
+        s[i] = i;
+    }
+    algo::merge_sort(s.begin(), s.end(), buffer.begin(), counting_less(comparisons));
+    failures += comparisons >= size_t(n);
+
+    for (int i = 0; i < 10; ++i)
+    {
+        std::swap(s[std::rand() % n], s[std::rand() % n]);
+    }
+    comparisons = 0;
+    algo::merge_sort(s.begin(), s.end(), buffer.begin(), counting_less(comparisons));
+    failures += comparisons >= size_t(2 * n);
+    failures += !std::is_sorted(s.begin(), s.end());
+
+    std::cout << "CASE_merge_sort_runs: " << (failures == 0 ? "PASSED" : "FAILED!!!") << '\n';
+}
+
+// key of a pair for radix_sort
+class first_of
+{
+public:
+    int operator() (const std::pair<int, int>& p) const
+    {
+        return p.first;
+    }
+};
+
+template<typename T>
+size_t radix_sort_test(const std::vector<T>& input)
+{
+    std::vector<T> expected(input), s(input), in_place(input), buffer(input.size());
+    std::sort(expected.begin(), expected.end());
+    algo::radix_sort(s.begin(), s.end(), buffer.begin());
+    algo::radix_sort_in_place(in_place.begin(), in_place.end());
+    return (s != expected) + (in_place != expected);
+}
+
+void CASE_radix_sort()
+{
+    const int n = 100000;
+    std::mt19937_64 gen(11);
+    std::vector<int> ints(n), small(n);
+    std::vector<unsigned long long> wide(n);
+    std::vector<float> floats(n);
+    std::vector<double> doubles(n);
+    for (int i = 0; i < n; ++i)
+    {
+        ints[i]    = int(gen());
+        small[i]   = int(gen() % 1000) - 500;  // high digits are constant
+        wide[i]    = gen();
+        floats[i]  = float(int(gen() % 2000000) - 1000000) / 7.0f;
+        doubles[i] = double((long long)(gen() >> 1) - (1LL << 62)) * 1e-9;
+    }
+
+    size_t failures = 0;
+    failures += radix_sort_test(ints);
+    failures += radix_sort_test(small);
+    failures += radix_sort_test(wide);
+    failures += radix_sort_test(floats);
+    failures += radix_sort_test(doubles);
+
+    // sorting by an extracted key, equal keys keep their order
+    std::vector<std::pair<int, int> > pairs(n), buffer(n);
+    for (int i = 0; i < n; ++i)
+    {
+        pairs[i] = std::make_pair(int(gen() % 200) - 100, i);
+    }
+    std::vector<std::pair<int, int> > stable(pairs), in_place(pairs);
+    std::stable_sort(stable.begin(), stable.end(), first_less());
+    algo::radix_sort(pairs.begin(), pairs.end(), buffer.begin(), first_of());
+    algo::radix_sort_in_place(in_place.begin(), in_place.end(), first_of());
+    failures += pairs != stable;
+
+    // the in-place sort is not stable, its output is ordered by key and a
+    // permutation of the input
+    failures += !std::is_sorted(in_place.begin(), in_place.end(), first_less());
+    std::sort(in_place.begin(), in_place.end());
+    std::sort(stable.begin(), stable.end());
+    failures += in_place != stable;
+
+    if (failures == 0)
+    {
+        std::cout << "CASE_radix_sort: PASSED\n";
+    }
+    else
+    {
+        std::cout << "CASE_radix_sort: FAILED!!!\n"
+            << "    radix_sort failure " << failures << '\n';
+    }
+}
+
+// element counting its copies, sorting should move elements only
+class copy_counted
+{
+public:
+    copy_counted(): value(0) {}
+    explicit copy_counted(int v): value(v) {}
+    copy_counted(const copy_counted& another): value(another.value) { ++copies; }
+    copy_counted(copy_counted&& another): value(another.value) {}
+
+    copy_counted& operator= (const copy_counted& another) { value = another.value; ++copies; return *this; }
+    copy_counted& operator= (copy_counted&& another) { value = another.value; return *this; }
+
+    bool operator< (const copy_counted& another) const { return value < another.value; }
+    bool operator== (const copy_counted& another) const { return value == another.value; }
+
+    int value;
+    static size_t copies;
+};
+
+size_t copy_counted::copies = 0;
+
+class value_of
+{
+public:
+    int operator() (const copy_counted& c) const
+    {
+        return c.value;
+    }
+};
+
+namespace algo
+{
+    // element type of the sorting namespace, whose lookup of swap() finds
+    // algo::swap as well as std::swap
+    class rec
+    {
+    public:
+        rec(): key(0) {}
+        explicit rec(int k): key(k) {}
+
+        bool operator< (const rec& another) const { return key < another.key; }
+        bool operator== (const rec& another) const { return key == another.key; }
+
+        int key;
+    };
+}
+
+void CASE_sort_moves()
+{
+    const int n = 50000;
+    std::vector<copy_counted> input, expected;
+    for (int i = 0; i < n; ++i)
+    {
+        input.push_back(copy_counted(std::rand() % 1000));
+    }
+    expected = input;
+    std::sort(expected.begin(), expected.end());
+
+    size_t failures = 0;
+    size_t copies = 0;
+    for (int sort = 0; sort < 7; ++sort)
+    {
+        std::vector<copy_counted> s(input), buffer(n);
+        copy_counted::copies = 0;
+        switch (sort)
+        {
+        case 0: algo::quick_sort(s.begin(), s.end()); break;
+        case 1: algo::heap_sort(s.begin(), s.end()); break;
+        case 2: algo::merge_sort(s.begin(), s.end(), buffer.begin()); break;
+        case 3: algo::parallel_sort(s.begin(), s.end(), algo::less<copy_counted>(), 2); break;
+        case 4: algo::parallel_merge_sort(s.begin(), s.end(), buffer.begin(), algo::less<copy_counted>(), 2); break;
+        case 5: algo::radix_sort(s.begin(), s.end(), buffer.begin(), value_of()); break;
+        default: algo::radix_sort_in_place(s.begin(), s.end(), value_of()); break;
+        }
+        copies += copy_counted::copies;
+        failures += s != expected;
+    }
+
+    std::vector<algo::rec> recs, sorted_recs;
+    for (int i = 0; i < n; ++i)
+    {
+        recs.push_back(algo::rec(input[i].value));
+    }
+    sorted_recs = recs;
+    std::sort(sorted_recs.begin(), sorted_recs.end());
+    for (int sort = 0; sort < 3; ++sort)
+    {
+        std::vector<algo::rec> s(recs), buffer(n);
+        switch (sort)
+        {
+        case 0: algo::quick_sort(s.begin(), s.end()); break;
+        case 1: algo::heap_sort(s.begin(), s.end()); break;
+        default: algo::merge_sort(s.begin(), s.end(), buffer.begin()); break;
+        }
+        failures += s != sorted_recs;
+    }
+
+    if (failures == 0 && copies == 0)
+    {
+        std::cout << "CASE_sort_moves: PASSED\n";
+    }
+    else
+    {
+        std::cout << "CASE_sort_moves: FAILED!!!\n"
+            << "    sort failure " << failures << '\n'
+            << "    copies " << copies << '\n';
+    }
+}
+
 void CASE_bsearch_basic()
 {
     std::vector<int> seq;
@@ -211,6 +708,271 @@ void CASE_lubound_basic()
     }
 }
 
+void CASE_lubound_sizes()
+{
+    size_t failures = 0;
+    for (int n = 0; n < 130; ++n)
+    {
+        // every value twice
+        std::vector<int> seq;
+        for (int i = 0; i < n; ++i)
+        {
+            seq.push_back(i / 2 * 2);
+        }
+
+        std::vector<int> values;
+        for (int v = -1; v <= n + 1; ++v)
+        {
+            values.push_back(v);
+            failures += algo::lower_bound(seq.begin(), seq.end(), v) != std::lower_bound(seq.begin(), seq.end(), v);
+            failures += algo::upper_bound(seq.begin(), seq.end(), v) != std::upper_bound(seq.begin(), seq.end(), v);
+            failures += algo::binary_search(seq.begin(), seq.end(), v) != std::binary_search(seq.begin(), seq.end(), v);
+            failures += algo::lower_bound(seq.data(), seq.data() + n, v) - seq.data() != std::lower_bound(seq.begin(), seq.end(), v) - seq.begin();
+        }
+
+        std::vector<std::vector<int>::iterator> bounds;
+        algo::lower_bound_many(seq.begin(), seq.end(), values.begin(), values.end(), std::back_inserter(bounds));
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            failures += bounds[i] != std::lower_bound(seq.begin(), seq.end(), values[i]);
+        }
+    }
+
+    // elements of std::vector<bool> are proxies, never prefetched
+    for (int n = 0; n < 70; ++n)
+    {
+        std::vector<bool> bits(n);
+        for (int i = n / 3; i < n; ++i)
+        {
+            bits[i] = true;
+        }
+        for (int b = 0; b < 2; ++b)
+        {
+            failures += algo::lower_bound(bits.begin(), bits.end(), b != 0) != std::lower_bound(bits.begin(), bits.end(), b != 0);
+            failures += algo::upper_bound(bits.begin(), bits.end(), b != 0) != std::upper_bound(bits.begin(), bits.end(), b != 0);
+        }
+    }
+
+    std::cout << "CASE_lubound_sizes: " << (failures == 0 ? "PASSED" : "FAILED!!!") << '\n';
+}
+
+void CASE_eytzinger_index()
+{
+    size_t failures = 0;
+    for (int n = 0; n < 300; ++n)
+    {
+        // every value twice
+        std::vector<int> seq;
+        for (int i = 0; i < n; ++i)
+        {
+            seq.push_back(i / 2 * 2);
+        }
+
+        algo::eytzinger_index<int> index(seq.begin(), seq.end());
+        failures += index.size() != seq.size();
+        for (int v = -1; v <= n + 1; ++v)
+        {
+            failures += index.lower_bound(v) != size_t(std::lower_bound(seq.begin(), seq.end(), v) - seq.begin());
+            failures += index.upper_bound(v) != size_t(std::upper_bound(seq.begin(), seq.end(), v) - seq.begin());
+        }
+    }
+
+    std::mt19937 gen(46);
+    std::vector<double> seq(100000);
+    for (size_t i = 0; i < seq.size(); ++i)
+    {
+        seq[i] = std::uniform_real_distribution<double>(0, 1000)(gen);
+    }
+    std::sort(seq.begin(), seq.end(), std::greater<double>());
+
+    algo::eytzinger_index<double, std::greater<double> > index(seq.begin(), seq.end(), std::greater<double>());
+    for (int i = 0; i < 10000; ++i)
+    {
+        double v = std::uniform_real_distribution<double>(-1, 1001)(gen);
+        failures += index.lower_bound(v) != size_t(std::lower_bound(seq.begin(), seq.end(), v, std::greater<double>()) - seq.begin());
+    }
+
+    std::cout << "CASE_eytzinger_index: " << (failures == 0 ? "PASSED" : "FAILED!!!") << '\n';
+}
+
+void CASE_external_sort()
+{
+    size_t failures = 0;
+
+    // binary records, enough for several merge passes in 64KB
+    std::vector<int> values(200000);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = std::rand() % 100000 - 50000;
+    }
+    std::FILE* f = std::fopen("external_sort_test.in", "wb");
+    std::fwrite(&values[0], sizeof(int), values.size(), f);
+    std::fclose(f);
+
+    failures += !algo::external_sort<int>("external_sort_test.in", "external_sort_test.out", algo::less<int>(), 64 << 10);
+    std::sort(values.begin(), values.end());
+    std::vector<int> sorted(values.size() + 1);
+    f = std::fopen("external_sort_test.out", "rb");
+    failures += f ? std::fread(&sorted[0], sizeof(int), sorted.size(), f) != values.size() : 1;
+    if (f)
+    {
+        std::fclose(f);
+    }
+    sorted.pop_back();
+    failures += sorted != values;
+
+    // memory below the minimum is raised to it
+    failures += !algo::external_sort<int>("external_sort_test.in", "external_sort_test.out", algo::less<int>(), 0);
+    f = std::fopen("external_sort_test.out", "rb");
+    failures += f ? std::fread(&sorted[0], sizeof(int), values.size(), f) != values.size() : 1;
+    if (f)
+    {
+        std::fclose(f);
+    }
+    failures += sorted != values;
+
+    // runs can not be written into a missing directory
+    failures += algo::external_sort<int>("external_sort_test.in", "external_sort_test.out", algo::less<int>(), 64 << 10, "external_sort_test.none");
+
+    // run files are created under names no file has, skipping those taken
+    std::string run = algo::_external_run_path(".");
+    size_t dot = run.rfind('.', run.size() - 5);
+    unsigned long next = std::stoul(run.substr(dot + 1)) + 1;
+    std::string taken = run.substr(0, dot + 1) + std::to_string(next) + ".run";
+    f = std::fopen(taken.c_str(), "wb");
+    std::fputs("taken", f);
+    std::fclose(f);
+    std::string after = algo::_external_run_path(".");
+    failures += after == taken || after == run || after.empty();
+    f = std::fopen(taken.c_str(), "rb");
+    failures += f ? std::fgetc(f) != 't' : 1;
+    if (f)
+    {
+        std::fclose(f);
+    }
+    std::remove(run.c_str());
+    std::remove(taken.c_str());
+    std::remove(after.c_str());
+
+    // lines, the last one without '\n'
+    std::vector<std::string> lines;
+    std::string text;
+    for (int i = 0; i < 20000; ++i)
+    {
+        lines.push_back(std::string(std::rand() % 20, char('a' + std::rand() % 26)) + std::to_string(std::rand()));
+        text += lines.back() + (i + 1 < 20000 ? "\n" : "");
+    }
+    f = std::fopen("external_sort_test.in", "wb");
+    std::fwrite(text.data(), 1, text.size(), f);
+    std::fclose(f);
+
+    failures += !algo::external_sort_lines("external_sort_test.in", "external_sort_test.out", algo::less<std::string>(), 64 << 10);
+    std::sort(lines.begin(), lines.end());
+    std::string expected;
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        expected += lines[i] + "\n";
+    }
+    std::string result(expected.size() + 1, '\0');
+    f = std::fopen("external_sort_test.out", "rb");
+    failures += f ? std::fread(&result[0], 1, result.size(), f) != expected.size() : 1;
+    if (f)
+    {
+        std::fclose(f);
+    }
+    result.resize(expected.size());
+    failures += result != expected;
+
+    // empty input, and a missing one
+    f = std::fopen("external_sort_test.in", "wb");
+    std::fclose(f);
+    failures += !algo::external_sort<int>("external_sort_test.in", "external_sort_test.out");
+    f = std::fopen("external_sort_test.out", "rb");
+    failures += f ? std::fgetc(f) != EOF : 1;
+    if (f)
+    {
+        std::fclose(f);
+    }
+    std::remove("external_sort_test.in");
+    failures += algo::external_sort<int>("external_sort_test.in", "external_sort_test.out");
+    std::remove("external_sort_test.out");
+
+    std::cout << "CASE_external_sort: " << (failures == 0 ? "PASSED" : "FAILED!!!") << '\n';
+}
+
+void CASE_merge_k()
+{
+    size_t failures = 0;
+    for (int k = 0; k < 40; ++k)
+    {
+        // second elements tell the range and position of equal keys
+        std::vector<std::vector<std::pair<int, int> > > shards(k);
+        std::vector<std::pair<int, int> > expected;
+        for (int i = 0; i < k; ++i)
+        {
+            int count = std::rand() % (i % 5 ? 200 : 1);
+            for (int j = 0; j < count; ++j)
+            {
+                shards[i].push_back(std::make_pair(std::rand() % 50, i * 1000 + j));
+            }
+            std::stable_sort(shards[i].begin(), shards[i].end(), first_less());
+            expected.insert(expected.end(), shards[i].begin(), shards[i].end());
+        }
+        std::stable_sort(expected.begin(), expected.end(), first_less());
+
+        typedef std::vector<std::pair<int, int> >::const_iterator shard_iterator;
+        std::vector<std::pair<shard_iterator, shard_iterator> > ranges;
+        for (int i = 0; i < k; ++i)
+        {
+            ranges.push_back(std::make_pair(shards[i].begin(), shards[i].end()));
+        }
+
+        std::vector<std::pair<int, int> > merged;
+        algo::merge_k(ranges.begin(), ranges.end(), std::back_inserter(merged), first_less());
+        failures += merged != expected;
+    }
+
+    // streams in, stream out
+    std::istringstream a("1 4 4 9"), b(""), c("2 3 4 10 11");
+    typedef std::istream_iterator<int> int_reader;
+    std::pair<int_reader, int_reader> streams[] =
+    {
+        std::make_pair(int_reader(a), int_reader()),
+        std::make_pair(int_reader(b), int_reader()),
+        std::make_pair(int_reader(c), int_reader())
+    };
+    std::ostringstream out;
+    algo::merge_k(streams, streams + 3, std::ostream_iterator<int>(out, " "));
+    failures += out.str() != "1 2 3 4 4 4 9 10 11 ";
+
+    // a comparison per match, none against empty or exhausted ranges
+    std::vector<std::vector<int> > runs(13);
+    size_t total = 0;
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+        runs[i].resize(i % 4 ? 1000 * i : 0);
+        for (size_t j = 0; j < runs[i].size(); ++j)
+        {
+            runs[i][j] = std::rand() % 1000;
+        }
+        std::sort(runs[i].begin(), runs[i].end());
+        total += runs[i].size();
+    }
+    typedef std::vector<int>::const_iterator run_iterator;
+    std::vector<std::pair<run_iterator, run_iterator> > run_ranges;
+    for (size_t i = 0; i < runs.size(); ++i)
+    {
+        run_ranges.push_back(std::make_pair(runs[i].begin(), runs[i].end()));
+    }
+    std::vector<int> run_merged(total);
+    size_t comparisons = 0;
+    algo::merge_k(run_ranges.begin(), run_ranges.end(), run_merged.begin(), counting_less(comparisons));
+    failures += !std::is_sorted(run_merged.begin(), run_merged.end());
+    failures += comparisons > total * 4 + 16;
+
+    std::cout << "CASE_merge_k: " << (failures == 0 ? "PASSED" : "FAILED!!!") << '\n';
+}
+
 void CASE_slist()
 {
     size_t failures = 0;
@@ -353,3 +1115,58 @@ void CASE_linear_select()
     }
     std::cout << "CASE_linear_select: PASSED\n";
 }
+
+void CASE_lsm_map()
+{
+    // small buffers and fanout, so that runs are merged over several levels
+    algo::lsm_map<int, int> m(64, 3);
+    std::map<int, int> expected;
+    std::srand(7);
+    for (int i = 0; i < 20000; ++i)
+    {
+        int k = std::rand() % 3000;
+        if (i % 5 == 4)
+        {
+            m.erase(k);
+            expected.erase(k);
+        }
+        else
+        {
+            m.insert(std::make_pair(k, i));
+            expected[k] = i;
+        }
+    }
+
+    size_t failures = 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int k = -10; k < 3010; ++k)
+        {
+            int v = -1;
+            bool found = m.find(k, v);
+            std::map<int, int>::iterator it = expected.find(k);
+            failures += found != (it != expected.end()) || (found && v != it->second);
+        }
+        m.flush();
+    }
+
+    // rewrites of a key take a single entry of the buffer
+    algo::lsm_map<int, int> hot(64, 3);
+    for (int i = 0; i < 1000; ++i)
+    {
+        hot.insert(std::make_pair(i % 8, i));
+    }
+    int hv = -1;
+    bool rewritten = hot.runs() == 0 && hot.find(7, hv) && hv == 999;
+
+    if (failures == 0 && rewritten && m.runs() > 1 && m.write_amplification() > 1.0)
+    {
+        std::cout << "CASE_lsm_map: PASSED\n";
+    }
+    else
+    {
+        std::cout << "CASE_lsm_map: FAILED!!!\n"
+            << "    lookup failure " << failures << '\n'
+            << "    rewrites buffered " << rewritten << '\n';
+    }
+}
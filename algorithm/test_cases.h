@@ -3,10 +3,23 @@
 
 void CASE_sort_basic();
 void CASE_sort_random();
+void CASE_sort_patterns();
+void CASE_parallel_sort();
+void CASE_merge_sort_runs();
+void CASE_small_sort();
+void CASE_radix_sort();
+void CASE_sort_moves();
 void CASE_bsearch_basic();
 void CASE_lubound_basic();
+void CASE_lubound_sizes();
+void CASE_eytzinger_index();
+void CASE_external_sort();
+void CASE_merge_k();
 void CASE_slist();
 void CASE_disjoint_set();
 void CASE_linear_select();
+void CASE_lsm_map();
+
+void PERF_parallel_sort();
 
 #endif
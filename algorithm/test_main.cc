@@ -29,11 +29,28 @@ int main(int argc, char* argv[])
 
     //CASE_sort_basic();
     //CASE_sort_random();
+    CASE_sort_patterns();
+    CASE_parallel_sort();
+    CASE_merge_sort_runs();
+    CASE_small_sort();
+    CASE_radix_sort();
+    CASE_sort_moves();
+    CASE_lubound_sizes();
+    CASE_eytzinger_index();
+    CASE_external_sort();
+    CASE_merge_k();
     //CASE_bsearch_basic();
     //CASE_lubound_basic();
     //CASE_slist();
     //CASE_disjoint_set();
     CASE_linear_select();
+    CASE_lsm_map();
+
+    // benchmarks, given any argument
+    if( argc > 1 )
+    {
+        PERF_parallel_sort();
+    }
 
     return 0;
 }
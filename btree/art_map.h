@@ -0,0 +1,941 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <type_traits>
+
+#include "btree_helper.h"
+
+namespace btree_helper
+{
+    // Byte string of a key for radix trees. Byte strings compare like the
+    // keys they encode, and none is a prefix of another.
+    template<typename K, bool Integral = std::is_integral<K>::value>
+    class radix_key
+    {
+        static_assert(Integral, "btree_helper::radix_key is not specialized for this type");
+    };
+
+    // big-endian bytes, with the sign bit flipped for signed integers
+    template<typename K>
+    class radix_key<K, true>
+    {
+    public:
+        static void encode(const K& k, std::string& out)
+        {
+            typedef typename std::make_unsigned<K>::type unsigned_type;
+
+            unsigned_type u = unsigned_type(k);
+            if( std::is_signed<K>::value )
+            {
+                u ^= unsigned_type(1) << (8 * sizeof(K) - 1);
+            }
+
+            out.resize(sizeof(K));
+            for(size_t i = 0; i < sizeof(K); ++i)
+            {
+                out[i] = char(u >> (8 * (sizeof(K) - 1 - i)));
+            }
+        }
+    };
+
+    // the characters followed by a zero byte, with bytes 0 and 1 escaped as
+    // 1 1 and 1 2
+    template<typename Traits, typename Alloc>
+    class radix_key<std::basic_string<char, Traits, Alloc>, false>
+    {
+    public:
+        static void encode(const std::basic_string<char, Traits, Alloc>& k, std::string& out)
+        {
+            out.clear();
+            out.reserve(k.size() + 1);
+            for(size_t i = 0; i < k.size(); ++i)
+            {
+                unsigned char c = k[i];
+                if( c < 2 )
+                {
+                    out.push_back(1);
+                    ++c;
+                }
+                out.push_back(char(c));
+            }
+            out.push_back(0);
+        }
+    };
+}
+
+namespace algo
+{
+    // Adaptive radix tree, an ordered map with the interface of btree.
+    // Keys are encoded as byte strings by btree_helper::radix_key, and a key
+    // is located by its bytes, one level per byte, without comparisons.
+    // Inner nodes grow and shrink among 4 sorted, 16 sorted, 48 indexed and
+    // 256 direct children. Chains of single-child nodes are compressed into
+    // a prefix of the next node, up to max_prefix bytes are stored, the rest
+    // is checked against a leaf of the subtree.
+    template<typename K, typename V>
+    class art_map
+    {
+    private:
+        class node;
+        class leaf;
+        class inner;
+
+    public:
+        typedef art_map<K, V>       my_type;
+        typedef std::pair<K, V>     value_type;
+        typedef K                   key_type;
+
+        enum
+        {
+            max_prefix = 8,
+        };
+
+        // forward iterator, keeps the path from the root
+        class iterator
+        {
+        public:
+            iterator(): _leaf(nullptr) {}
+
+            value_type& operator* () { return _leaf->val; }
+            value_type* operator->() { return &_leaf->val; }
+
+            iterator& operator++() { advance(); return *this; }
+
+            bool operator== (const iterator& another) const { return _leaf == another._leaf; }
+            bool operator!= (const iterator& another) const { return _leaf != another._leaf; }
+
+        private:
+            friend class art_map;
+
+            // an inner node on the path and the slot of the child stepped into
+            class step
+            {
+            public:
+                step(inner* n, size_t p): node(n), pos(p) {}
+
+                inner* node;
+                size_t pos;
+            };
+
+            // go down to the leftmost leaf of subtree n
+            void descend(node* n)
+            {
+                while( n->type != leaf_node )
+                {
+                    inner* in = static_cast<inner*>(n);
+                    size_t pos = next_slot(in, 0);
+                    _path.push_back(step(in, pos));
+                    n = slot(in, pos);
+                }
+                _leaf = static_cast<leaf*>(n);
+            }
+
+            // go to the leftmost leaf on the right of the current subtree
+            void advance()
+            {
+                while( !_path.empty() )
+                {
+                    step& s = _path.back();
+                    s.pos = next_slot(s.node, s.pos + 1);
+                    if( s.pos != npos )
+                    {
+                        descend(slot(s.node, s.pos));
+                        return;
+                    }
+                    _path.pop_back();
+                }
+                _leaf = nullptr;
+            }
+
+            std::vector<step> _path;
+            leaf*             _leaf;
+        };
+
+        art_map(): _root(nullptr), _size(0) {}
+        ~art_map() { destroy(_root); }
+
+        // insert a key-value pair, overwrite existing value
+        void insert(const value_type& val);
+
+        // erase a key-value pair
+        void erase(const key_type& k);
+
+        bool   empty() const { return !_size; }
+        size_t size() const  { return _size; }
+
+        iterator begin()
+        {
+            iterator it;
+            if( _root )
+            {
+                it.descend(_root);
+            }
+            return it;
+        }
+        iterator end() { return iterator(); }
+
+        iterator find(const key_type& k);
+
+        // Find the first key not less than k
+        iterator lower_bound(const key_type& k);
+
+    private:
+        typedef btree_helper::radix_key<K> radix_key;
+
+        enum node_type { leaf_node, node4, node16, node48, node256 };
+        enum { npos = size_t(-1) };
+
+        class node
+        {
+        public:
+            explicit node(node_type t): type(t) {}
+
+            node_type type;
+        };
+
+        class leaf : public node
+        {
+        public:
+            explicit leaf(const value_type& v): node(leaf_node), val(v) {}
+
+            value_type val;
+        };
+
+        class inner : public node
+        {
+        public:
+            explicit inner(node_type t): node(t), count(0), prefix_len(0) {}
+
+            size_t        count;
+            size_t        prefix_len;
+            unsigned char prefix[max_prefix];
+        };
+
+        // children sorted by their bytes
+        template<node_type Type, size_t Capacity>
+        class sorted_node : public inner
+        {
+        public:
+            sorted_node(): inner(Type)
+            {
+                std::memset(child, 0, sizeof(child));
+            }
+
+            unsigned char keys[Capacity];
+            node*         child[Capacity];
+        };
+        typedef sorted_node<node4, 4>   node_4;
+        typedef sorted_node<node16, 16> node_16;
+
+        // index holds 1 + position of the child of every byte, 0 if none
+        class node_48 : public inner
+        {
+        public:
+            node_48(): inner(node48)
+            {
+                std::memset(index, 0, sizeof(index));
+                std::memset(child, 0, sizeof(child));
+            }
+
+            unsigned char index[256];
+            node*         child[48];
+        };
+
+        class node_256 : public inner
+        {
+        public:
+            node_256(): inner(node256)
+            {
+                std::memset(child, 0, sizeof(child));
+            }
+
+            node* child[256];
+        };
+
+        // Children are addressed by slots: the position in sorted nodes, the
+        // byte in the others.
+        static node*&        slot(inner* n, size_t pos);
+        static unsigned char slot_byte(const inner* n, size_t pos);
+
+        // slot of the child of byte b, npos if none
+        static size_t find_slot(inner* n, unsigned char b);
+
+        // first occupied slot from pos on, npos if none
+        static size_t next_slot(inner* n, size_t pos);
+
+        // first occupied slot whose byte is not less than b, npos if none
+        static size_t lower_slot(inner* n, unsigned char b);
+
+        // add child c of byte b to n, growing n into ref if it is full
+        static void add_child(node*& ref, inner* n, unsigned char b, node* c);
+
+        // remove the child in slot pos from n, shrinking n into ref if it is
+        // sparse, the child itself is not freed
+        static void remove_child(node*& ref, inner* n, size_t pos);
+
+        static void copy_header(inner* to, const inner* from);
+        static void set_prefix(inner* n, const std::string& key, size_t depth, size_t len);
+
+        // Position of the first byte of the prefix of n differing from key
+        // at depth, prefix_len if none. cmp tells whether the prefix is less
+        // (-1) or greater (1) there.
+        static size_t mismatch(inner* n, const std::string& key, size_t depth, int& cmp);
+
+        static leaf* minimum(node* n);
+
+        // free node n only, or the whole subtree
+        static void free_node(node* n);
+        static void destroy(node* n);
+
+        static unsigned char byte(const std::string& key, size_t i) { return static_cast<unsigned char>(key[i]); }
+
+        bool insert(node*& ref, const std::string& key, size_t depth, const value_type& val);
+        bool remove(node*& ref, const std::string& key, size_t depth);
+
+        art_map(const my_type&);
+        my_type& operator= (const my_type&);
+
+    private:
+        node*  _root;
+        size_t _size;
+    };
+
+    template<typename K, typename V>
+    typename art_map<K, V>::node*& art_map<K, V>::slot(inner* n, size_t pos)
+    {
+        switch( n->type )
+        {
+        case node4:  return static_cast<node_4*>(n)->child[pos];
+        case node16: return static_cast<node_16*>(n)->child[pos];
+        case node48: return static_cast<node_48*>(n)->child[static_cast<node_48*>(n)->index[pos] - 1];
+        default:     return static_cast<node_256*>(n)->child[pos];
+        }
+    }
+
+    template<typename K, typename V>
+    unsigned char art_map<K, V>::slot_byte(const inner* n, size_t pos)
+    {
+        switch( n->type )
+        {
+        case node4:  return static_cast<const node_4*>(n)->keys[pos];
+        case node16: return static_cast<const node_16*>(n)->keys[pos];
+        default:     return static_cast<unsigned char>(pos);
+        }
+    }
+
+    template<typename K, typename V>
+    size_t art_map<K, V>::find_slot(inner* n, unsigned char b)
+    {
+        switch( n->type )
+        {
+        case node4:
+        case node16:
+            {
+                const unsigned char* keys = n->type == node4 ? static_cast<node_4*>(n)->keys : static_cast<node_16*>(n)->keys;
+                for(size_t i = 0; i < n->count; ++i)
+                {
+                    if( keys[i] == b )
+                    {
+                        return i;
+                    }
+                }
+                return npos;
+            }
+        case node48:
+            return static_cast<node_48*>(n)->index[b] ? b : size_t(npos);
+        default:
+            return static_cast<node_256*>(n)->child[b] ? b : size_t(npos);
+        }
+    }
+
+    template<typename K, typename V>
+    size_t art_map<K, V>::next_slot(inner* n, size_t pos)
+    {
+        switch( n->type )
+        {
+        case node4:
+        case node16:
+            return pos < n->count ? pos : size_t(npos);
+        case node48:
+            for(; pos < 256; ++pos)
+            {
+                if( static_cast<node_48*>(n)->index[pos] )
+                {
+                    return pos;
+                }
+            }
+            return npos;
+        default:
+            for(; pos < 256; ++pos)
+            {
+                if( static_cast<node_256*>(n)->child[pos] )
+                {
+                    return pos;
+                }
+            }
+            return npos;
+        }
+    }
+
+    template<typename K, typename V>
+    size_t art_map<K, V>::lower_slot(inner* n, unsigned char b)
+    {
+        if( n->type != node4 && n->type != node16 )
+        {
+            return next_slot(n, b);
+        }
+
+        const unsigned char* keys = n->type == node4 ? static_cast<node_4*>(n)->keys : static_cast<node_16*>(n)->keys;
+        size_t i = 0;
+        while( i < n->count && keys[i] < b )
+        {
+            ++i;
+        }
+        return i < n->count ? i : size_t(npos);
+    }
+
+    template<typename K, typename V>
+    void art_map<K, V>::copy_header(inner* to, const inner* from)
+    {
+        to->count      = from->count;
+        to->prefix_len = from->prefix_len;
+        std::memcpy(to->prefix, from->prefix, max_prefix);
+    }
+
+    template<typename K, typename V>
+    void art_map<K, V>::set_prefix(inner* n, const std::string& key, size_t depth, size_t len)
+    {
+        n->prefix_len = len;
+        for(size_t i = 0; i < len && i < max_prefix; ++i)
+        {
+            n->prefix[i] = byte(key, depth + i);
+        }
+    }
+
+    template<typename K, typename V>
+    void art_map<K, V>::add_child(node*& ref, inner* n, unsigned char b, node* c)
+    {
+        switch( n->type )
+        {
+        case node4:
+        case node16:
+            {
+                size_t capacity = n->type == node4 ? 4 : 16;
+                if( n->count == capacity )
+                {
+                    break;
+                }
+
+                unsigned char* keys  = n->type == node4 ? static_cast<node_4*>(n)->keys  : static_cast<node_16*>(n)->keys;
+                node**         child = n->type == node4 ? static_cast<node_4*>(n)->child : static_cast<node_16*>(n)->child;
+                size_t i = n->count;
+                for(; i > 0 && b < keys[i-1]; --i)
+                {
+                    keys[i]  = keys[i-1];
+                    child[i] = child[i-1];
+                }
+                keys[i]  = b;
+                child[i] = c;
+                ++n->count;
+                return;
+            }
+        case node48:
+            {
+                node_48* m = static_cast<node_48*>(n);
+                if( m->count == 48 )
+                {
+                    break;
+                }
+
+                size_t i = 0;
+                while( m->child[i] )
+                {
+                    ++i;
+                }
+                m->child[i] = c;
+                m->index[b] = static_cast<unsigned char>(i + 1);
+                ++m->count;
+                return;
+            }
+        default:
+            static_cast<node_256*>(n)->child[b] = c;
+            ++n->count;
+            return;
+        }
+
+        // n is full, move its children to a larger node
+        inner* grown;
+        if( n->type == node4 )
+        {
+            node_4*  from = static_cast<node_4*>(n);
+            node_16* to   = new node_16();
+            std::memcpy(to->keys, from->keys, sizeof(from->keys));
+            std::memcpy(to->child, from->child, sizeof(from->child));
+            grown = to;
+        }
+        else if( n->type == node16 )
+        {
+            node_16* from = static_cast<node_16*>(n);
+            node_48* to   = new node_48();
+            for(size_t i = 0; i < 16; ++i)
+            {
+                to->index[from->keys[i]] = static_cast<unsigned char>(i + 1);
+                to->child[i] = from->child[i];
+            }
+            grown = to;
+        }
+        else
+        {
+            node_48*  from = static_cast<node_48*>(n);
+            node_256* to   = new node_256();
+            for(size_t i = 0; i < 256; ++i)
+            {
+                if( from->index[i] )
+                {
+                    to->child[i] = from->child[from->index[i] - 1];
+                }
+            }
+            grown = to;
+        }
+
+        copy_header(grown, n);
+        free_node(n);
+        ref = grown;
+        add_child(ref, grown, b, c);
+    }
+
+    template<typename K, typename V>
+    void art_map<K, V>::remove_child(node*& ref, inner* n, size_t pos)
+    {
+        if( n->type == node4 || n->type == node16 )
+        {
+            unsigned char* keys  = n->type == node4 ? static_cast<node_4*>(n)->keys  : static_cast<node_16*>(n)->keys;
+            node**         child = n->type == node4 ? static_cast<node_4*>(n)->child : static_cast<node_16*>(n)->child;
+            for(size_t i = pos + 1; i < n->count; ++i)
+            {
+                keys[i-1]  = keys[i];
+                child[i-1] = child[i];
+            }
+            --n->count;
+        }
+        else if( n->type == node48 )
+        {
+            node_48* m = static_cast<node_48*>(n);
+            m->child[m->index[pos] - 1] = nullptr;
+            m->index[pos] = 0;
+            --m->count;
+        }
+        else
+        {
+            static_cast<node_256*>(n)->child[pos] = nullptr;
+            --n->count;
+        }
+
+        if( n->type == node4 && n->count == 1 )
+        {
+            // the only child takes over, with the prefix of n and the byte
+            // leading to it in front of its own prefix
+            node_4* m = static_cast<node_4*>(n);
+            node*   c = m->child[0];
+            if( c->type != leaf_node )
+            {
+                inner* in = static_cast<inner*>(c);
+                unsigned char prefix[max_prefix];
+                size_t len = 0;
+                for(size_t i = 0; i < m->prefix_len && len < max_prefix; ++i)
+                {
+                    prefix[len++] = m->prefix[i];
+                }
+                if( len < max_prefix )
+                {
+                    prefix[len++] = m->keys[0];
+                }
+                for(size_t i = 0; i < in->prefix_len && len < max_prefix; ++i)
+                {
+                    prefix[len++] = in->prefix[i];
+                }
+                std::memcpy(in->prefix, prefix, len);
+                in->prefix_len += m->prefix_len + 1;
+            }
+            free_node(n);
+            ref = c;
+            return;
+        }
+
+        // move the children of a sparse node to a smaller one
+        inner* shrunk = nullptr;
+        if( n->type == node16 && n->count == 3 )
+        {
+            node_16* from = static_cast<node_16*>(n);
+            node_4*  to   = new node_4();
+            std::memcpy(to->keys, from->keys, 3);
+            std::memcpy(to->child, from->child, 3 * sizeof(node*));
+            shrunk = to;
+        }
+        else if( n->type == node48 && n->count == 12 )
+        {
+            node_48* from = static_cast<node_48*>(n);
+            node_16* to   = new node_16();
+            for(size_t i = 0, j = 0; i < 256; ++i)
+            {
+                if( from->index[i] )
+                {
+                    to->keys[j]  = static_cast<unsigned char>(i);
+                    to->child[j] = from->child[from->index[i] - 1];
+                    ++j;
+                }
+            }
+            shrunk = to;
+        }
+        else if( n->type == node256 && n->count == 37 )
+        {
+            node_256* from = static_cast<node_256*>(n);
+            node_48*  to   = new node_48();
+            for(size_t i = 0, j = 0; i < 256; ++i)
+            {
+                if( from->child[i] )
+                {
+                    to->index[i] = static_cast<unsigned char>(j + 1);
+                    to->child[j] = from->child[i];
+                    ++j;
+                }
+            }
+            shrunk = to;
+        }
+
+        if( shrunk )
+        {
+            copy_header(shrunk, n);
+            free_node(n);
+            ref = shrunk;
+        }
+    }
+
+    template<typename K, typename V>
+    size_t art_map<K, V>::mismatch(inner* n, const std::string& key, size_t depth, int& cmp)
+    {
+        // bytes of the prefix beyond max_prefix are taken from any leaf
+        std::string full;
+        for(size_t i = 0; i < n->prefix_len; ++i)
+        {
+            if( i == max_prefix )
+            {
+                radix_key::encode(minimum(n)->val.first, full);
+            }
+
+            if( depth + i >= key.size() )
+            {
+                cmp = 1;
+                return i;
+            }
+
+            unsigned char p = i < max_prefix ? n->prefix[i] : byte(full, depth + i);
+            if( p != byte(key, depth + i) )
+            {
+                cmp = p < byte(key, depth + i) ? -1 : 1;
+                return i;
+            }
+        }
+        cmp = 0;
+        return n->prefix_len;
+    }
+
+    template<typename K, typename V>
+    typename art_map<K, V>::leaf* art_map<K, V>::minimum(node* n)
+    {
+        while( n->type != leaf_node )
+        {
+            inner* in = static_cast<inner*>(n);
+            n = slot(in, next_slot(in, 0));
+        }
+        return static_cast<leaf*>(n);
+    }
+
+    template<typename K, typename V>
+    void art_map<K, V>::free_node(node* n)
+    {
+        switch( n->type )
+        {
+        case leaf_node: delete static_cast<leaf*>(n);     break;
+        case node4:     delete static_cast<node_4*>(n);   break;
+        case node16:    delete static_cast<node_16*>(n);  break;
+        case node48:    delete static_cast<node_48*>(n);  break;
+        default:        delete static_cast<node_256*>(n); break;
+        }
+    }
+
+    template<typename K, typename V>
+    void art_map<K, V>::destroy(node* n)
+    {
+        if( !n )
+        {
+            return;
+        }
+
+        if( n->type != leaf_node )
+        {
+            inner* in = static_cast<inner*>(n);
+            for(size_t pos = next_slot(in, 0); pos != npos; pos = next_slot(in, pos + 1))
+            {
+                destroy(slot(in, pos));
+            }
+        }
+        free_node(n);
+    }
+
+    template<typename K, typename V>
+    void art_map<K, V>::insert(const value_type& val)
+    {
+        std::string key;
+        radix_key::encode(val.first, key);
+        _size += insert(_root, key, 0, val);
+    }
+
+    template<typename K, typename V>
+    bool art_map<K, V>::insert(node*& ref, const std::string& key, size_t depth, const value_type& val)
+    {
+        node* n = ref;
+        if( !n )
+        {
+            ref = new leaf(val);
+            return true;
+        }
+
+        if( n->type == leaf_node )
+        {
+            leaf* l = static_cast<leaf*>(n);
+            std::string existing;
+            radix_key::encode(l->val.first, existing);
+            if( existing == key )
+            {
+                l->val.second = val.second;
+                return false;
+            }
+
+            // Both keys go under a new node at their first different byte,
+            // which comes before the end of either key
+            size_t p = depth;
+            while( existing[p] == key[p] )
+            {
+                ++p;
+            }
+            node_4* m = new node_4();
+            set_prefix(m, key, depth, p - depth);
+            ref = m;
+            add_child(ref, m, byte(existing, p), l);
+            add_child(ref, m, byte(key, p), new leaf(val));
+            return true;
+        }
+
+        inner* in = static_cast<inner*>(n);
+        int cmp;
+        size_t p = mismatch(in, key, depth, cmp);
+        if( p < in->prefix_len )
+        {
+            // split the prefix, the key and n go under a new node
+            node_4* m = new node_4();
+            set_prefix(m, key, depth, p);
+
+            unsigned char b;
+            if( in->prefix_len <= max_prefix )
+            {
+                b = in->prefix[p];
+                std::memmove(in->prefix, in->prefix + p + 1, in->prefix_len - p - 1);
+            }
+            else
+            {
+                std::string full;
+                radix_key::encode(minimum(in)->val.first, full);
+                b = byte(full, depth + p);
+                for(size_t i = 0; i < max_prefix && depth + p + 1 + i < full.size(); ++i)
+                {
+                    in->prefix[i] = byte(full, depth + p + 1 + i);
+                }
+            }
+            in->prefix_len -= p + 1;
+
+            ref = m;
+            add_child(ref, m, b, in);
+            add_child(ref, m, byte(key, depth + p), new leaf(val));
+            return true;
+        }
+
+        depth += in->prefix_len;
+        size_t pos = find_slot(in, byte(key, depth));
+        if( pos != npos )
+        {
+            return insert(slot(in, pos), key, depth + 1, val);
+        }
+
+        add_child(ref, in, byte(key, depth), new leaf(val));
+        return true;
+    }
+
+    template<typename K, typename V>
+    void art_map<K, V>::erase(const key_type& k)
+    {
+        if( !_root )
+        {
+            return;
+        }
+
+        std::string key;
+        radix_key::encode(k, key);
+        _size -= remove(_root, key, 0);
+    }
+
+    template<typename K, typename V>
+    bool art_map<K, V>::remove(node*& ref, const std::string& key, size_t depth)
+    {
+        node* n = ref;
+        if( n->type == leaf_node )
+        {
+            std::string existing;
+            radix_key::encode(static_cast<leaf*>(n)->val.first, existing);
+            if( existing != key )
+            {
+                return false;
+            }
+            free_node(n);
+            ref = nullptr;
+            return true;
+        }
+
+        inner* in = static_cast<inner*>(n);
+        int cmp;
+        if( mismatch(in, key, depth, cmp) < in->prefix_len )
+        {
+            return false;
+        }
+
+        depth += in->prefix_len;
+        size_t pos = depth < key.size() ? find_slot(in, byte(key, depth)) : size_t(npos);
+        if( pos == npos )
+        {
+            return false;
+        }
+
+        // a removed leaf leaves an empty slot in n, an inner child replaces
+        // itself when it shrinks
+        node*& child = slot(in, pos);
+        bool leaf_child = child->type == leaf_node;
+        if( !remove(child, key, depth + 1) )
+        {
+            return false;
+        }
+        if( leaf_child )
+        {
+            remove_child(ref, in, pos);
+        }
+        return true;
+    }
+
+    template<typename K, typename V>
+    typename art_map<K, V>::iterator art_map<K, V>::find(const key_type& k)
+    {
+        std::string key;
+        radix_key::encode(k, key);
+
+        // only the stored bytes of prefixes are checked on the way down, the
+        // leaf tells whether the key is there
+        iterator it;
+        size_t depth = 0;
+        node* n = _root;
+        while( n && n->type != leaf_node )
+        {
+            inner* in = static_cast<inner*>(n);
+            for(size_t i = 0; i < in->prefix_len && i < max_prefix; ++i)
+            {
+                if( depth + i >= key.size() || in->prefix[i] != byte(key, depth + i) )
+                {
+                    return end();
+                }
+            }
+
+            depth += in->prefix_len;
+            size_t pos = depth < key.size() ? find_slot(in, byte(key, depth)) : size_t(npos);
+            if( pos == npos )
+            {
+                return end();
+            }
+            it._path.push_back(typename iterator::step(in, pos));
+            n = slot(in, pos);
+            ++depth;
+        }
+
+        if( !n )
+        {
+            return end();
+        }
+
+        std::string existing;
+        radix_key::encode(static_cast<leaf*>(n)->val.first, existing);
+        if( existing != key )
+        {
+            return end();
+        }
+        it._leaf = static_cast<leaf*>(n);
+        return it;
+    }
+
+    template<typename K, typename V>
+    typename art_map<K, V>::iterator art_map<K, V>::lower_bound(const key_type& k)
+    {
+        std::string key;
+        radix_key::encode(k, key);
+
+        iterator it;
+        size_t depth = 0;
+        node* n = _root;
+        while( n )
+        {
+            if( n->type == leaf_node )
+            {
+                it._leaf = static_cast<leaf*>(n);
+                std::string existing;
+                radix_key::encode(it._leaf->val.first, existing);
+                if( existing < key )
+                {
+                    it.advance();
+                }
+                return it;
+            }
+
+            // a subtree whose prefix differs from the key is entirely
+            // greater or entirely less than the key
+            inner* in = static_cast<inner*>(n);
+            int cmp;
+            mismatch(in, key, depth, cmp);
+            depth += in->prefix_len;
+            if( cmp < 0 )
+            {
+                it.advance();
+                return it;
+            }
+            if( cmp > 0 || depth >= key.size() )
+            {
+                it.descend(n);
+                return it;
+            }
+
+            unsigned char b = byte(key, depth);
+            size_t pos = lower_slot(in, b);
+            if( pos == npos )
+            {
+                it.advance();
+                return it;
+            }
+
+            it._path.push_back(typename iterator::step(in, pos));
+            n = slot(in, pos);
+            if( slot_byte(in, pos) != b )
+            {
+                it.descend(n);
+                return it;
+            }
+            ++depth;
+        }
+        return it;
+    }
+}
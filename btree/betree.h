@@ -0,0 +1,240 @@
+#pragma once
+#include <functional>
+#include "betree_node.h"
+
+namespace algo
+{
+    // Write-optimized B-epsilon tree.
+    // Inserts, erases and upserts are buffered as messages in internal nodes
+    // and flushed downward in batches, so a write rarely touches a leaf.
+    // Queries merge the buffered messages found on their path.
+    //  Order:  max number of subtrees of an internal node
+    //  Buffer: max number of messages buffered by an internal node, which is
+    //          also the max number of key-value pairs stored in a leaf
+    //  Upsert: associative functor combining a delta into a value, upserting
+    //          an absent key combines the delta into V()
+    template<
+        typename K,
+        typename V,
+        size_t   Order,
+        size_t   Buffer = 8 * Order,
+        typename Upsert = std::plus<V> >
+    class betree
+    {
+    public:
+        typedef betree<K, V, Order, Buffer, Upsert>      my_type;
+        typedef betree_node<K, V, Order, Buffer, Upsert> node_type;
+        typedef typename node_type::value_type           value_type;
+        typedef typename node_type::key_type             key_type;
+        typedef typename node_type::message              message;
+
+        betree(): _root(new node_type()) {}
+
+        // insert a key-value pair into the tree, overwrite existing value
+        void insert(const value_type& val)
+        {
+            write(message(message::put, val.first, val.second));
+        }
+
+        // erase a key-value pair from the tree
+        void erase(const key_type& k)
+        {
+            write(message(message::erase, k, V()));
+        }
+
+        // combine delta into the value of key k
+        void upsert(const key_type& k, const V& delta)
+        {
+            write(message(message::upsert, k, delta));
+        }
+
+        // search for key k, returns false if it is not found
+        bool find(const key_type& k, V& v);
+
+        // visit all key-value pairs in ascending order
+        template<typename Function>
+        void for_each(Function fn)
+        {
+            message_v pending;
+            scan(_root, pending, nullptr, nullptr, fn);
+        }
+
+        // visit key-value pairs within key range [lo, hi) in ascending order
+        template<typename Function>
+        void for_each(const key_type& lo, const key_type& hi, Function fn)
+        {
+            if( !(lo < hi) )
+            {
+                return;
+            }
+
+            message_v pending;
+            scan(_root, pending, &lo, &hi, fn);
+        }
+
+    private:
+        typedef typename node_type::shptr            node_ptr;
+        typedef typename node_type::keyvalue_v       keyvalue_v;
+        typedef typename node_type::message_v        message_v;
+        typedef typename node_type::message_iterator message_iterator;
+        typedef typename node_type::msgcomp          msgcomp;
+
+        // put message m into the root and restore the limits of root
+        void write(const message& m);
+
+        // visit pairs of subtree p within [lo, hi), nullptr for unbounded.
+        // pending: messages for the subtree buffered by ancestors of p
+        template<typename Function>
+        void scan(node_ptr p, message_v& pending, const key_type* lo, const key_type* hi, Function& fn);
+
+    private:
+        node_ptr _root;
+    };
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    void betree<K, V, Order, Buffer, Upsert>::write(const message& m)
+    {
+        if( _root->is_leaf() )
+        {
+            node_type::apply_messages(_root->key(), &m, &m + 1);
+        }
+        else
+        {
+            message_iterator it = _root->locate_message(m.first);
+            if( it != _root->buffer().end() && !(m.first < it->first) )
+            {
+                *it = node_type::combine(*it, m);
+            }
+            else
+            {
+                _root->buffer().insert(it, m);
+            }
+            _root->flush();
+        }
+
+        if( _root->overfull() )
+        {
+            // grow a new root
+            node_ptr root(new node_type());
+            root->sub().push_back(_root);
+            _root = root;
+            _root->split_child(0);
+        }
+
+        while( !_root->is_leaf() && _root->sub().size() == 1 )
+        {
+            // the only subtree receives everything and becomes the new root
+            _root->flush_child(0);
+            if( _root->sub().size() == 1 )
+            {
+                _root = _root->sub().front();
+            }
+        }
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    bool betree<K, V, Order, Buffer, Upsert>::find(const key_type& k, V& v)
+    {
+        // deltas of pending upserts, from the newest to the oldest
+        std::vector<const V*> deltas;
+        bool found = false;
+        V    base  = V();
+
+        node_ptr p = _root;
+        while( !p->is_leaf() )
+        {
+            message_iterator m = p->locate_message(k);
+            if( m != p->buffer().end() && !(k < m->first) )
+            {
+                if( m->op != message::upsert )
+                {
+                    found = m->op == message::put;
+                    base  = m->second;
+                    break;
+                }
+                deltas.push_back(&m->second);
+            }
+            p = p->sub()[p->locate_child(k)];
+        }
+
+        if( p->is_leaf() )
+        {
+            typename keyvalue_v::iterator it = std::lower_bound(
+                p->key().begin(), p->key().end(), value_type(k, V()), btree_helper::compare<K, V>());
+            if( it != p->key().end() && !(k < it->first) )
+            {
+                found = true;
+                base  = it->second;
+            }
+        }
+
+        if( !found && deltas.empty() )
+        {
+            return false;
+        }
+
+        static Upsert fn;
+        for(size_t i = deltas.size(); i != 0; --i)
+        {
+            base = fn(base, *deltas[i-1]);
+        }
+        v = base;
+        return true;
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    template<typename Function>
+    void betree<K, V, Order, Buffer, Upsert>::scan(node_ptr p, message_v& pending,
+                                                   const key_type* lo, const key_type* hi, Function& fn)
+    {
+        if( p->is_leaf() )
+        {
+            typename keyvalue_v::iterator first = p->key().begin(), last = p->key().end();
+            if( lo )
+            {
+                first = std::lower_bound(first, last, value_type(*lo, V()), btree_helper::compare<K, V>());
+            }
+            if( hi )
+            {
+                last = std::lower_bound(first, last, value_type(*hi, V()), btree_helper::compare<K, V>());
+            }
+
+            if( pending.empty() )
+            {
+                for(; first != last; ++first)
+                {
+                    fn(*first);
+                }
+                return;
+            }
+
+            keyvalue_v merged(first, last);
+            node_type::apply_messages(merged, pending.begin(), pending.end());
+            for(first = merged.begin(); first != merged.end(); ++first)
+            {
+                fn(*first);
+            }
+            return;
+        }
+
+        // messages of current node are older than the pending ones
+        message_iterator mfirst = lo ? p->locate_message(*lo) : p->buffer().begin();
+        message_iterator mlast  = hi ? p->locate_message(*hi) : p->buffer().end();
+        message_v merged(mfirst, mlast);
+        node_type::merge_messages(merged, pending.begin(), pending.end());
+
+        size_t first = lo ? p->locate_child(*lo) : 0;
+        size_t last  = hi ? p->locate_child(*hi) : p->sub().size() - 1;
+        message_iterator it = merged.begin();
+        for(size_t n = first; n <= last; ++n)
+        {
+            message_iterator next = n < p->pivot().size()
+                ? std::lower_bound(it, merged.end(), p->pivot()[n], msgcomp())
+                : merged.end();
+
+            message_v sub_pending(it, next);
+            scan(p->sub()[n], sub_pending, lo, hi, fn);
+            it = next;
+        }
+    }
+}
@@ -0,0 +1,375 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "btree_helper.h"
+
+namespace algo
+{
+    // A pending modification buffered by an internal node of a B-epsilon tree
+    template<typename K, typename V>
+    class betree_message
+    {
+    public:
+        enum kind
+        {
+            put,     // insert or overwrite the value
+            erase,   // remove the key
+            upsert,  // combine value into the existing value
+        };
+
+        betree_message() {}
+        betree_message(kind k, const K& key, const V& val): op(k), first(key), second(val) {}
+
+        kind op;
+        K    first;
+        V    second;
+    };
+
+    // Node of a B-epsilon tree.
+    // A leaf node stores ordered key-value pairs. An internal node stores
+    // pivots, subtrees and an ordered buffer of messages that have not been
+    // applied to the subtrees yet. Keys of sub()[i] fall in
+    // [pivot()[i-1], pivot()[i]), messages in the buffer are newer than anything
+    // stored below the node.
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    class betree_node
+    {
+    public:
+        typedef betree_node<K, V, Order, Buffer, Upsert> my_type;
+        typedef std::pair<K, V>                          value_type;
+        typedef K                                        key_type;
+        typedef betree_message<K, V>                     message;
+        typedef std::shared_ptr<my_type>                 shptr;
+        typedef std::vector<value_type>                  keyvalue_v;
+        typedef std::vector<K>                           pivot_v;
+        typedef std::vector<shptr>                       subtree_v;
+        typedef std::vector<message>                     message_v;
+        typedef typename message_v::iterator             message_iterator;
+
+        // Limits on a B-epsilon tree node
+        // #sub of an internal node should be in range [sub_lower, sub_upper]
+        // #key of a leaf node should be in range [key_lower, key_upper]
+        // #message of an internal node should not exceed msg_upper
+        enum
+        {
+            sub_lower = (Order + 1) / 2,
+            sub_upper = Order,
+            key_lower = Buffer / 4,
+            key_upper = Buffer,
+            msg_upper = Buffer,
+        };
+
+        // key-value pairs stored in a leaf node
+        keyvalue_v&   key()                         { return _keyvalues; }
+
+        // pivots and subtrees of an internal node
+        pivot_v&      pivot()                       { return _pivots; }
+        subtree_v&    sub()                         { return _subtrees; }
+
+        // pending messages of an internal node
+        message_v&    buffer()                      { return _messages; }
+
+        // Tests whether current node is leaf node
+        bool is_leaf() const { return _subtrees.empty(); }
+
+        // Tests whether current node has too many subtrees or keys
+        bool overfull() const
+        {
+            return is_leaf() ? _keyvalues.size() > key_upper : _subtrees.size() > sub_upper;
+        }
+
+        // Tests whether current node has too few subtrees or keys
+        bool underfull() const
+        {
+            return is_leaf() ? _keyvalues.size() < key_lower : _subtrees.size() < sub_lower;
+        }
+
+        // Position of the subtree whose key range covers k
+        size_t locate_child(const K& k) const
+        {
+            return std::upper_bound(_pivots.begin(), _pivots.end(), k) - _pivots.begin();
+        }
+
+        // Position of the first message in the buffer not less than k
+        message_iterator locate_message(const K& k)
+        {
+            return std::lower_bound(_messages.begin(), _messages.end(), k, msgcomp());
+        }
+
+        // Receives a batch of ordered messages from the parent, which are newer
+        // than anything stored in current node
+        template<typename Iterator>
+        void absorb(Iterator first, Iterator last);
+
+        // Pushes buffered messages down until the buffer is within limits
+        void flush();
+
+        // Pushes all buffered messages of sub()[n] down to sub()[n]
+        void flush_child(size_t n);
+
+        // Restores the limits of sub()[n] by splitting or merging it
+        void fix_child(size_t n);
+
+        // Splits sub()[n] into two halves, recursively while overfull
+        void split_child(size_t n);
+
+        // Merges sub()[n+1] into sub()[n]
+        void merge_children(size_t n);
+
+        // Combines message older with message newer on the same key
+        static message combine(const message& older, const message& newer);
+
+        // Merges ordered messages [first, last) into ordered messages dst.
+        // Messages in [first, last) are newer than messages in dst.
+        template<typename Iterator>
+        static void merge_messages(message_v& dst, Iterator first, Iterator last);
+
+        // Applies ordered messages [first, last) to ordered key-value pairs dst
+        template<typename Iterator>
+        static void apply_messages(keyvalue_v& dst, Iterator first, Iterator last);
+
+        class msgcomp
+        {
+        public:
+            bool operator() (const message& m, const K& k) const { return m.first < k; }
+            bool operator() (const K& k, const message& m) const { return k < m.first; }
+        };
+
+    private:
+        keyvalue_v _keyvalues;
+        pivot_v    _pivots;
+        subtree_v  _subtrees;
+        message_v  _messages;
+    };
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    typename betree_node<K, V, Order, Buffer, Upsert>::message
+    betree_node<K, V, Order, Buffer, Upsert>::combine(const message& older, const message& newer)
+    {
+        if( newer.op != message::upsert )
+        {
+            return newer;
+        }
+
+        static Upsert fn;
+        switch( older.op )
+        {
+        case message::put:
+            return message(message::put, newer.first, fn(older.second, newer.second));
+        case message::erase:
+            return message(message::put, newer.first, fn(V(), newer.second));
+        default:
+            return message(message::upsert, newer.first, fn(older.second, newer.second));
+        }
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    template<typename Iterator>
+    void betree_node<K, V, Order, Buffer, Upsert>::merge_messages(message_v& dst, Iterator first, Iterator last)
+    {
+        message_v merged;
+        merged.reserve(dst.size() + (last - first));
+
+        message_iterator it = dst.begin();
+        while( it != dst.end() && first != last )
+        {
+            if( it->first < first->first )
+            {
+                merged.push_back(*it++);
+            }
+            else if( first->first < it->first )
+            {
+                merged.push_back(*first++);
+            }
+            else
+            {
+                merged.push_back(combine(*it++, *first++));
+            }
+        }
+        merged.insert(merged.end(), it, dst.end());
+        merged.insert(merged.end(), first, last);
+        dst.swap(merged);
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    template<typename Iterator>
+    void betree_node<K, V, Order, Buffer, Upsert>::apply_messages(keyvalue_v& dst, Iterator first, Iterator last)
+    {
+        static Upsert fn;
+
+        keyvalue_v merged;
+        merged.reserve(dst.size() + (last - first));
+
+        typename keyvalue_v::iterator it = dst.begin();
+        while( first != last )
+        {
+            for(; it != dst.end() && it->first < first->first; ++it)
+            {
+                merged.push_back(*it);
+            }
+
+            bool exists = it != dst.end() && !(first->first < it->first);
+            switch( first->op )
+            {
+            case message::put:
+                merged.push_back(value_type(first->first, first->second));
+                break;
+            case message::upsert:
+                merged.push_back(value_type(first->first, fn(exists ? it->second : V(), first->second)));
+                break;
+            default:
+                break; // erased, just skip it
+            }
+
+            if( exists )
+            {
+                ++it;
+            }
+            ++first;
+        }
+        merged.insert(merged.end(), it, dst.end());
+        dst.swap(merged);
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    template<typename Iterator>
+    void betree_node<K, V, Order, Buffer, Upsert>::absorb(Iterator first, Iterator last)
+    {
+        if( is_leaf() )
+        {
+            apply_messages(_keyvalues, first, last);
+            return;
+        }
+
+        merge_messages(_messages, first, last);
+        flush();
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    void betree_node<K, V, Order, Buffer, Upsert>::flush()
+    {
+        while( _messages.size() > msg_upper )
+        {
+            // flush the subtree which receives the largest batch
+            size_t best = 0, best_count = 0;
+            message_iterator it = _messages.begin();
+            for(size_t n = 0; n < _subtrees.size(); ++n)
+            {
+                message_iterator next = n < _pivots.size()
+                    ? std::lower_bound(it, _messages.end(), _pivots[n], msgcomp())
+                    : _messages.end();
+                if( size_t(next - it) > best_count )
+                {
+                    best = n;
+                    best_count = next - it;
+                }
+                it = next;
+            }
+            flush_child(best);
+        }
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    void betree_node<K, V, Order, Buffer, Upsert>::flush_child(size_t n)
+    {
+        message_iterator first = n ? locate_message(_pivots[n-1]) : _messages.begin();
+        message_iterator last  = n < _pivots.size() ? locate_message(_pivots[n]) : _messages.end();
+        if( first == last )
+        {
+            return;
+        }
+
+        _subtrees[n]->absorb(first, last);
+        _messages.erase(first, last);
+        fix_child(n);
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    void betree_node<K, V, Order, Buffer, Upsert>::fix_child(size_t n)
+    {
+        if( _subtrees[n]->overfull() )
+        {
+            split_child(n);
+            return;
+        }
+
+        if( !_subtrees[n]->underfull() || _subtrees.size() < 2 )
+        {
+            return;
+        }
+
+        // merge with a sibling, then split again if the result is too large
+        n = n + 1 < _subtrees.size() ? n : n - 1;
+        merge_children(n);
+        _subtrees[n]->flush();
+        if( _subtrees[n]->overfull() )
+        {
+            split_child(n);
+        }
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    void betree_node<K, V, Order, Buffer, Upsert>::split_child(size_t n)
+    {
+        shptr lchild = _subtrees[n];
+        shptr rchild(new my_type());
+        K separator;
+
+        if( lchild->is_leaf() )
+        {
+            size_t break_pos = lchild->_keyvalues.size() / 2;
+            separator = lchild->_keyvalues[break_pos].first;
+            btree_helper::move(lchild->_keyvalues, break_pos, rchild->_keyvalues);
+        }
+        else
+        {
+            // pivot()[break_pos-1] moves up to separate the two halves
+            size_t break_pos = lchild->_subtrees.size() / 2;
+            separator = lchild->_pivots[break_pos-1];
+            btree_helper::move(lchild->_pivots, break_pos, rchild->_pivots);
+            lchild->_pivots.pop_back();
+            btree_helper::move(lchild->_subtrees, break_pos, rchild->_subtrees);
+
+            size_t mp = lchild->locate_message(separator) - lchild->_messages.begin();
+            btree_helper::move(lchild->_messages, mp, rchild->_messages);
+        }
+
+        btree_helper::insert(_pivots, n, separator);
+        btree_helper::insert(_subtrees, n+1, rchild);
+
+        if( rchild->overfull() )
+        {
+            split_child(n+1);
+        }
+        if( lchild->overfull() )
+        {
+            split_child(n);
+        }
+    }
+
+    template<typename K, typename V, size_t Order, size_t Buffer, typename Upsert>
+    void betree_node<K, V, Order, Buffer, Upsert>::merge_children(size_t n)
+    {
+        shptr lsub = _subtrees[n];
+        shptr rsub = _subtrees[n+1];
+
+        if( lsub->is_leaf() )
+        {
+            lsub->_keyvalues.insert(lsub->_keyvalues.end(), rsub->_keyvalues.begin(), rsub->_keyvalues.end());
+        }
+        else
+        {
+            // key ranges of the two subtrees are disjoint, thus the buffers
+            // are simply concatenated
+            lsub->_pivots.push_back(_pivots[n]);
+            lsub->_pivots.insert(lsub->_pivots.end(), rsub->_pivots.begin(), rsub->_pivots.end());
+            lsub->_subtrees.insert(lsub->_subtrees.end(), rsub->_subtrees.begin(), rsub->_subtrees.end());
+            lsub->_messages.insert(lsub->_messages.end(), rsub->_messages.begin(), rsub->_messages.end());
+        }
+
+        btree_helper::erase(_pivots, n);
+        btree_helper::erase(_subtrees, n+1);
+    }
+}
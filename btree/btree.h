@@ -1,60 +1,162 @@
 #pragma once
+#include <thread>
+#include <cstddef>
+#include <iterator>
+#include <functional>
 #include "btree_node.h"
 
 namespace algo
 {
     template<typename, typename, size_t>
-    class btree;
+    class frozen_btree;
 
-    // naive forward iterator
-    template<typename K, typename V, size_t Order>
+    template<typename, typename, size_t, size_t>
+    class packed_btree;
+
+    // bidirectional iterator
+    // The path from the root is kept on a fixed-size stack, so stepping out of
+    // a node needs no parent pointers. Copies take the steps in use only.
+    // An iterator given by the front cache of find() knows its node only, it
+    // locates the neighbouring key from the root once it steps out of that
+    // node.
+    // end() knows the root too: decrementing it gives the last key, and
+    // decrementing the first key gives end().
+    template<typename K, typename V, size_t Order, typename Aggregate = btree_helper::no_aggregate<V>,
+             typename Encoding = btree_helper::plain_encoding>
     class btree_iterator
     {
     private:
-        typedef typename btree_node<K,V,Order>        node_type;
-        typedef typename btree_node<K,V,Order>::shptr node_ptr;
-    
+        typedef btree_node<K,V,Order,Aggregate,Encoding>     node_type;
+        typedef typename node_type::limits                   limits;
+
     public:
-        typedef typename node_type::value_type        value_type;
-        typedef btree_iterator<K,V,Order>             my_type;
+        typedef typename node_type::value_type               value_type;
+        typedef btree_iterator<K,V,Order,Aggregate,Encoding> my_type;
+        typedef std::bidirectional_iterator_tag              iterator_category;
+        typedef ptrdiff_t                                    difference_type;
+        typedef typename node_type::pointer                  pointer;
+        typedef typename node_type::reference                reference;
+        typedef typename node_type::const_pointer            const_pointer;
+        typedef typename node_type::const_reference          const_reference;
+
+        btree_iterator(): _depth(0), _root(nullptr) {}
+
+        // copies the steps in use only, as many as the height of the tree
+        btree_iterator(const my_type& another)
+            : _depth(another._depth), _root(another._root)
+        {
+            std::copy(another._path, another._path + _depth, _path);
+        }
 
-        btree_iterator(): _g(-1), _ptr(nullptr) {}
+        btree_iterator& operator= (const my_type& another)
+        {
+            _depth = another._depth;
+            _root  = another._root;
+            std::copy(another._path, another._path + _depth, _path);
+            return *this;
+        }
 
-        value_type& operator* () { return _ptr->key()[_g]; }
-        value_type* operator->() { return &(_ptr->key()[_g]); }
+        reference operator* () const { return top().node->key()[top().pos]; }
+        pointer   operator->() const { return btree_helper::address(top().node->key(), top().pos); }
 
         btree_iterator& operator++()
         {
-            if( !_ptr->is_leaf() )
+            if( !_depth )
             {
-                // if this is not leaf then we are back from a leaf
-                // thus here g < key_count()
-                _ptr = _ptr->sub()[_g+1];
-                _g = 0;
+                // end(), start over from the first key
+                if( _root && _root->key_count() )
+                {
+                    descend(_root, false);
+                }
+                return *this;
+            }
 
+            step& s = top();
+            if( !s.node->is_leaf() )
+            {
+                // if this is not leaf then we are back from a leaf
+                // thus here pos < key_count()
                 // Go down to first element of next subtree
-                while( !_ptr->is_leaf() )
+                descend(s.node->sub()[++s.pos].get(), false);
+            }
+            else
+            {
+                node_type* first = _path[0].node;
+                node_type* leaf = s.node;
+                ++s.pos;
+
+                // Go up, if we have finished visiting current node. The
+                // position of a subtree in its parent is the position of the
+                // next key to visit there.
+                while( _depth && top().node->key_count() <= top().pos )
+                {
+                    --_depth;
+                }
+
+                // the path started below the root, the next key may be anywhere
+                if( !_depth && first != _root )
+                {
+                    seek_after(leaf->key().back());
+                }
+            }
+            return *this;
+        }
+
+        btree_iterator& operator--()
+        {
+            if( !_depth )
+            {
+                // end(), step back to the last key
+                if( _root && _root->key_count() )
                 {
-                    _ptr = _ptr->sub()[0];
+                    descend(_root, true);
                 }
+                return *this;
+            }
+
+            step& s = top();
+            if( !s.node->is_leaf() )
+            {
+                // Go down to last element of the subtree before the key,
+                // the key is visited again when coming back up
+                descend(s.node->sub()[s.pos].get(), true);
+            }
+            else if( s.pos )
+            {
+                --s.pos;
             }
             else
             {
-                ++_g;
+                node_type* first = _path[0].node;
+                node_type* leaf = s.node;
 
-                // Go up, if we have finished visiting current node
-                while( _ptr && _ptr->key_count() <= _g )
+                // Go up to the first subtree not the leftmost of its parent,
+                // the key before it comes next
+                do
                 {
-                    _g = _ptr->get_selfpos();
-                    _ptr = _ptr->get_parent();
+                    --_depth;
+                } while( _depth && !top().pos );
+
+                if( _depth )
+                {
+                    --top().pos;
+                }
+                else if( first != _root )
+                {
+                    seek_before(leaf->key().front());
                 }
             }
             return *this;
         }
 
+        // iterators on the same key may have paths of different length
         bool operator== (const my_type& another) const
         {
-            return _ptr == another._ptr && _g == another._g;
+            if( !_depth || !another._depth )
+            {
+                return !_depth && !another._depth;
+            }
+            return top().node == another.top().node && top().pos == another.top().pos;
         }
 
         bool operator!= (const my_type& another) const
@@ -63,97 +165,903 @@ namespace algo
         }
 
     private:
-        template<typename, typename, size_t>
+        template<typename, typename, size_t, typename, typename>
         friend class btree;
 
-        btree_iterator(node_ptr p, size_t g): _ptr(p), _g(g){}
+        // a node on the path, pos is the position of the current key in the
+        // last node, or of the subtree stepped into in the others
+        class step
+        {
+        public:
+            node_type* node;
+            size_t     pos;
+        };
+
+        step&       top()                   { return _path[_depth-1]; }
+        const step& top() const             { return _path[_depth-1]; }
+        void        push(node_type* p, size_t g)  { _path[_depth].node = p; _path[_depth].pos = g; ++_depth; }
+
+        // the path starts below the root, as given by the front cache
+        bool partial() const { return _path[0].node != _root; }
 
-        node_ptr _ptr;
-        size_t   _g;
+        // extend the path from p down to the first or last key of p
+        void descend(node_type* p, bool last)
+        {
+            for(; !p->is_leaf(); p = p->sub()[top().pos].get())
+            {
+                push(p, last ? p->key_count() : 0);
+            }
+            push(p, last ? p->key_count() - 1 : 0);
+        }
+
+        // rebuild the path from the root to the first key greater than val
+        void seek_after(const value_type& val)
+        {
+            for(node_type* p = _root; ; p = p->sub()[top().pos].get())
+            {
+                push(p, p->locate_upper(val) - p->first_key());
+                if( p->is_leaf() ){ break; }
+            }
+
+            while( _depth && top().node->key_count() <= top().pos )
+            {
+                --_depth;
+            }
+        }
+
+        // rebuild the path from the root to the last key less than val
+        void seek_before(const value_type& val)
+        {
+            for(node_type* p = _root; ; p = p->sub()[top().pos].get())
+            {
+                push(p, p->locate(val) - p->first_key());
+                if( p->is_leaf() ){ break; }
+            }
+
+            while( _depth && !top().pos )
+            {
+                --_depth;
+            }
+            if( _depth )
+            {
+                --top().pos;
+            }
+        }
+
+        step       _path[limits::max_depth];
+        size_t     _depth;
+        node_type* _root;  // root of the tree, the path may start below it
+    };
+
+    // iterator giving read-only access to the pairs, converts from Iterator
+    template<typename Iterator>
+    class btree_const_iterator
+    {
+    public:
+        typedef typename Iterator::value_type      value_type;
+        typedef btree_const_iterator<Iterator>     my_type;
+        typedef std::bidirectional_iterator_tag    iterator_category;
+        typedef ptrdiff_t                          difference_type;
+        typedef typename Iterator::const_pointer   pointer;
+        typedef typename Iterator::const_reference reference;
+        typedef pointer                            const_pointer;
+        typedef reference                          const_reference;
+
+        btree_const_iterator() {}
+        btree_const_iterator(const Iterator& it): _it(it) {}
+
+        reference operator* () const { return *_it; }
+        pointer   operator->() const { return _it.operator->(); }
+
+        my_type& operator++() { ++_it; return *this; }
+        my_type& operator--() { --_it; return *this; }
+
+        bool operator== (const my_type& another) const { return _it == another._it; }
+        bool operator!= (const my_type& another) const { return _it != another._it; }
+
+    private:
+        Iterator _it;
+    };
+
+    // Iterator visiting pairs in descending order. Unlike with
+    // std::reverse_iterator, the underlying iterator is on the current pair
+    // itself, so dereferencing copies no path. rend() wraps end().
+    template<typename Iterator>
+    class btree_reverse_iterator
+    {
+    public:
+        typedef typename Iterator::value_type     value_type;
+        typedef btree_reverse_iterator<Iterator>  my_type;
+        typedef std::bidirectional_iterator_tag   iterator_category;
+        typedef ptrdiff_t                         difference_type;
+        typedef typename Iterator::pointer        pointer;
+        typedef typename Iterator::reference      reference;
+
+        btree_reverse_iterator() {}
+        explicit btree_reverse_iterator(const Iterator& it): _it(it) {}
+
+        // converts a reverse iterator into a const one
+        template<typename Other>
+        btree_reverse_iterator(const btree_reverse_iterator<Other>& other): _it(other.get()) {}
+
+        reference operator* () const { return *_it; }
+        pointer   operator->() const { return _it.operator->(); }
+
+        my_type& operator++() { --_it; return *this; }
+        my_type& operator--() { ++_it; return *this; }
+
+        bool operator== (const my_type& another) const { return _it == another._it; }
+        bool operator!= (const my_type& another) const { return _it != another._it; }
+
+        // the forward iterator on the same pair
+        const Iterator& get() const { return _it; }
+
+    private:
+        Iterator _it;
     };
 
     // memory b-tree
-    template<typename K, typename V, size_t Order>
+    // With Encoding btree_helper::delta_encoding, integer keys are stored as
+    // offsets within each node, and iterators give proxies of the pairs: a
+    // copy of the key and a reference to the value.
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
     class btree
     {
     public:
-        typedef btree<K, V, Order>              my_type;
-        typedef btree_node<K, V, Order>         node_type;
-        typedef typename node_type::value_type  value_type;
-        typedef typename node_type::key_type    key_type;
-        typedef btree_iterator<K, V, Order>     iterator;
+        typedef btree<K, V, Order, Aggregate, Encoding>          my_type;
+        typedef btree_node<K, V, Order, Aggregate, Encoding>     node_type;
+        typedef typename node_type::value_type                   value_type;
+        typedef typename node_type::key_type                     key_type;
+        typedef btree_iterator<K, V, Order, Aggregate, Encoding> iterator;
+        typedef btree_const_iterator<iterator>                   const_iterator;
+        typedef btree_reverse_iterator<iterator>                 reverse_iterator;
+        typedef btree_reverse_iterator<const_iterator>           const_reverse_iterator;
+        typedef typename Aggregate::aggregate_type               aggregate_type;
+
+        enum
+        {
+            cache_ways = 4, // entries per set of the front cache
+        };
 
-        btree(): _root(new node_type())    {}
+        btree(): _root(new node_type()), _size(0), _epoch(1), _hits(0), _misses(0) {}
 
         // insert a key-value pair into the tree
-        void insert(const value_type& val) { _root->insert(val); }
+        // keys greater than the current maximum are appended to the rightmost
+        // leaf directly without descending from the root
+        void insert(const value_type& val);
+
+        // insert a key-value pair into the tree, using hint as a suggestion of
+        // where to start the search. val is best placed just before hint.
+        void insert(iterator hint, const value_type& val);
 
         // erase a key-value pair from the tree
-        void erase(const key_type& k)
-        {
-            value_type tmp;
-            tmp.first = k;
-            _root->remove(tmp);
-        }
+        void erase(const key_type& k);
 
         // tests whether the tree is empty, i.e. the tree contains no any keys
         bool empty() const { return !_root->key_count(); }
 
+        // number of keys in the tree
+        size_t size() const { return _size; }
+
         iterator begin();
-        iterator end() { return iterator(); }
+        iterator end() { iterator it; it._root = _root.get(); return it; }
+
+        const_iterator begin() const { return const_cast<my_type*>(this)->begin(); }
+        const_iterator end() const   { return const_cast<my_type*>(this)->end(); }
+
+        // iterate in descending order, rend() is the position before the
+        // first key
+        reverse_iterator rbegin() { return reverse_iterator(--end()); }
+        reverse_iterator rend()   { return reverse_iterator(end()); }
+
+        const_reverse_iterator rbegin() const { return const_cast<my_type*>(this)->rbegin(); }
+        const_reverse_iterator rend() const   { return const_cast<my_type*>(this)->rend(); }
+
+        // Search for key k. With the front cache enabled, recently found keys
+        // are looked up in the cache before descending from the root.
         iterator find(const key_type& k);
 
+        // Enable the front cache of find() with room for the given number of
+        // keys, rounded up to a power of two number of sets, 0 disables it.
+        // Keys need a btree_helper::cache_hash, find() runs without the cache
+        // for others.
+        // Lookups through the cache update it, so concurrent calls of find()
+        // need exclusive access to the tree while the cache is enabled.
+        void enable_cache(size_t entries);
+
+        // number of find() calls answered by the front cache, and not
+        // answered by it, since it was enabled
+        size_t cache_hits() const   { return _hits; }
+        size_t cache_misses() const { return _misses; }
+
+        // Find the first key not less than k
+        iterator lower_bound(const key_type& k);
+
+        // Find the last key not greater than k, end() if there is none
+        iterator floor(const key_type& k);
+
+        // replace the contents with count ordered, unique key-value pairs
+        // starting from first. The tree is built bottom-up without splits.
+        template<typename InputIterator>
+        void assign_sorted(InputIterator first, size_t count);
+
+        // write all pairs in ascending order to os in a compact binary format,
+        // see btree_helper::stream_format. Returns false on a write error.
+        bool save(std::ostream& os);
+
+        // replace the contents with pairs written by save(), the tree is built
+        // bottom-up without splits. Returns false, leaving the contents
+        // unchanged, if the stream is broken or holds other types.
+        bool load(std::istream& is);
+
+        // make an immutable, cache-optimized copy of the tree
+        frozen_btree<K, V, Order> freeze();
+
+        // make an immutable copy with compressed leaves, for integer keys
+        packed_btree<K, V, Order, 128> pack();
+
+        // aggregate of the values of all keys, or of keys within [lo, hi).
+        // Aggregates are cached by nodes, thus values must not be modified
+        // through iterators unless Aggregate is btree_helper::no_aggregate.
+        aggregate_type aggregate() const { return _root->aggregate(); }
+        aggregate_type aggregate(const key_type& lo, const key_type& hi) const
+        {
+            return aggregate(_root, &lo, &hi);
+        }
+
+        // Split keys into partitions of roughly equal size at node boundaries
+        // and visit them on the given number of threads. fn(n, val) is called
+        // for every pair, n being the index of the partition in [0, threads).
+        // Pairs of a partition are visited in ascending order by one thread.
+        template<typename Function>
+        void parallel_for_each(Function fn, size_t threads)
+        {
+            parallel_for_each(nullptr, nullptr, fn, threads);
+        }
+
+        // Same as above, visits keys within [lo, hi) only
+        template<typename Function>
+        void parallel_for_each(const key_type& lo, const key_type& hi, Function fn, size_t threads)
+        {
+            parallel_for_each(&lo, &hi, fn, threads);
+        }
+
     private:
         typedef typename node_type::shptr         node_ptr;
         typedef typename node_type::key_iterator  key_iterator;
         typedef typename node_type::tree_iterator tree_iterator;
         typedef typename node_type::kvcomp        kvcomp;
 
+        // grow a new root above the current one and split the current one
+        void split_root(bool append);
+
+        // An entry of the front cache, the position of key in node. Inserts
+        // move keys by splits and shifts only, an entry stays valid while its
+        // key is found at its position. Erase may free nodes by merges, thus
+        // it starts a new epoch, which invalidates all entries.
+        class cache_entry
+        {
+        public:
+            cache_entry(): node(nullptr), pos(0), epoch(0) {}
+
+            key_type   key;
+            node_type* node;
+            size_t     pos;
+            size_t     epoch;
+        };
+
+        // aggregate of subtree p within [lo, hi), nullptr for unbounded
+        static aggregate_type aggregate(const node_ptr& p, const key_type* lo, const key_type* hi);
+
+        // A unit of parallel iteration, either a whole subtree or a single key
+        class work_item
+        {
+        public:
+            enum { subtree = size_t(-1) };
+
+            work_item(const node_ptr& p, size_t k, size_t w): node(p), key(k), weight(w) {}
+
+            node_ptr node;
+            size_t   key;     // position of the key in node, or subtree
+            size_t   weight;  // estimated number of keys
+        };
+        typedef std::vector<work_item> work_list;
+
+        template<typename Function>
+        void parallel_for_each(const key_type* lo, const key_type* hi, Function& fn, size_t threads);
+
+        // collect work items covering keys of subtree p within [lo, hi)
+        static void collect(const node_ptr& p, const key_type* lo, const key_type* hi, work_list& items);
+
+        // estimate number of keys of subtree p from its leftmost path
+        static size_t estimate(const node_ptr& p);
+
+        // visit all pairs of subtree p in order
+        template<typename Function>
+        static void visit(const node_ptr& p, size_t n, Function& fn);
+
+        // build a subtree of the given height from count pairs starting from it
+        template<typename InputIterator>
+        static node_ptr build(InputIterator& it, size_t count, size_t height);
+
+        // capacity of a subtree one level higher than one holding capacity
+        // keys, saturated instead of wrapping around
+        static size_t higher(size_t capacity)
+        {
+            return capacity > (size_t(-1) - (Order - 1)) / Order ? size_t(-1) : capacity * Order + Order - 1;
+        }
+
     private:
         node_ptr _root;
+        node_ptr _rightmost; // cached rightmost leaf, nullptr if unknown
+        size_t   _size;
+
+        std::vector<cache_entry> _cache;  // front cache of find, sets of cache_ways entries
+        size_t                   _epoch;
+        size_t                   _hits, _misses;
     };
 
-    template<typename K, typename V, size_t Order>
-    typename btree<K, V, Order>::iterator btree<K, V, Order>::begin()
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree<K, V, Order, Aggregate, Encoding>::insert(const value_type& val)
+    {
+        typedef typename node_type::limits limits;
+
+        if( !_rightmost && !empty() )
+        {
+            node_ptr p = _root;
+            while( !p->is_leaf() )
+            {
+                p = p->sub().back();
+            }
+            _rightmost = p;
+        }
+
+        bool append = _rightmost && kvcomp::less(_rightmost->key().back(), val);
+        if( append && !Aggregate::enabled && !_rightmost->is_full() )
+        {
+            _rightmost->key().push_back(val);
+            ++_size;
+            return;
+        }
+
+        // Inserting into the rightmost leaf changes its key count, which is
+        // the only way to split it or to put a new leaf to its right.
+        size_t watched = _rightmost ? _rightmost->key_count() : 0;
+
+        if( limits::top_down && _root->is_full() )
+        {
+            split_root(append);
+        }
+        _size += _root->insert(val, append);
+        if( !limits::top_down && _root->key_count() >= limits::key_upper )
+        {
+            split_root(append);
+        }
+
+        if( _rightmost && (append || _rightmost->key_count() != watched) )
+        {
+            _rightmost.reset();
+        }
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree<K, V, Order, Aggregate, Encoding>::insert(iterator hint, const value_type& val)
     {
-        if( !_root->key_count() )
+        if( !hint._depth )
         {
-            return iterator();
+            // hint is end(), the key most likely goes to the right edge
+            return insert(val);
         }
 
-        node_ptr p = _root;
-        while( !p->is_leaf() )
+        if( Aggregate::enabled && hint.partial() )
+        {
+            // hint is from the front cache, its ancestors are unknown
+            return insert(val);
+        }
+
+        node_type* p = hint.top().node;
+        size_t     g = hint.top().pos;
+
+        // The hint is only usable if val falls in between the key before hint
+        // and the hint itself, and both keys are in the same node. A full node
+        // may have to be split, which needs its parent, so start from the root.
+        if( g == 0 || !kvcomp::less(p->key()[g-1], val) || kvcomp::less(p->key()[g], val) )
         {
-            p = p->sub()[0];
+            return insert(val);
         }
 
-        return iterator(p, 0);
+        bool overwrite = !kvcomp::less(val, p->key()[g]);
+        if( !overwrite && p->is_full() )
+        {
+            return insert(val);
+        }
+
+        size_t watched = _rightmost ? _rightmost->key_count() : 0;
+        _size += p->insert(val);
+        if( _rightmost && _rightmost->key_count() != watched )
+        {
+            _rightmost.reset();
+        }
+
+        // ancestors of p cache aggregates of their subtrees
+        for(size_t d = hint._depth - 1; Aggregate::enabled && d != 0; --d)
+        {
+            hint._path[d-1].node->update_aggregate();
+        }
     }
 
-    template<typename K, typename V, size_t Order>
-    typename btree<K, V, Order>::iterator btree<K, V, Order>::find(const key_type& k)
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree<K, V, Order, Aggregate, Encoding>::erase(const key_type& k)
     {
-        if( empty() )
+        value_type tmp;
+        tmp.first = k;
+        _size -= _root->remove(tmp);
+
+        // the root loses its last key when its only two subtrees are merged
+        if( !_root->key_count() && !_root->is_leaf() )
+        {
+            _root = _root->sub().front();
+        }
+        _rightmost.reset();
+        ++_epoch;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree<K, V, Order, Aggregate, Encoding>::split_root(bool append)
+    {
+        node_ptr root(new node_type());
+        root->sub().push_back(_root);
+        _root = root;
+        _root->split_child(0, append);
+        _root->update_aggregate();
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    typename btree<K, V, Order, Aggregate, Encoding>::iterator btree<K, V, Order, Aggregate, Encoding>::begin()
+    {
+        iterator it = end();
+        if( _root->key_count() )
+        {
+            it.descend(_root.get(), false);
+        }
+        return it;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    typename btree<K, V, Order, Aggregate, Encoding>::iterator btree<K, V, Order, Aggregate, Encoding>::find(const key_type& k)
+    {
+        typedef btree_helper::cache_hash<key_type> hash;
+
+        if( !hash::enabled || _cache.empty() )
+        {
+            iterator it = lower_bound(k);
+            return it != end() && !kvcomp::key_less(k, it->first) ? it : end();
+        }
+
+        size_t sets = _cache.size() / cache_ways;
+        cache_entry* e = &_cache[(hash::of(k) & (sets - 1)) * cache_ways];
+        size_t w = 0;
+        for(; w < cache_ways; ++w)
+        {
+            if( e[w].epoch == _epoch && kvcomp::key_equal(e[w].key, k) )
+            {
+                break;
+            }
+        }
+
+        if( w < cache_ways && e[w].pos < e[w].node->key_count() )
+        {
+            typename node_type::reference found = e[w].node->key()[e[w].pos];
+            if( kvcomp::key_equal(found.first, k) )
+            {
+                iterator it = end();
+                it.push(e[w].node, e[w].pos);
+
+                // hot keys move to the front of their set, away from eviction
+                if( w )
+                {
+                    std::swap(e[w], e[w-1]);
+                }
+                ++_hits;
+                return it;
+            }
+        }
+
+        ++_misses;
+        iterator it = lower_bound(k);
+        if( it == end() || kvcomp::key_less(k, it->first) )
         {
             return end();
         }
 
+        // reuse the stale entry of k if any, evict the last one otherwise
+        cache_entry& slot = e[w < cache_ways ? w : cache_ways - 1];
+        slot.key   = k;
+        slot.node  = it.top().node;
+        slot.pos   = it.top().pos;
+        slot.epoch = _epoch;
+        return it;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree<K, V, Order, Aggregate, Encoding>::enable_cache(size_t entries)
+    {
+        size_t sets = entries && btree_helper::cache_hash<key_type>::enabled ? 1 : 0;
+        while( sets && sets * cache_ways < entries )
+        {
+            sets *= 2;
+        }
+
+        _cache.assign(sets * cache_ways, cache_entry());
+        _hits   = 0;
+        _misses = 0;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    typename btree<K, V, Order, Aggregate, Encoding>::iterator btree<K, V, Order, Aggregate, Encoding>::lower_bound(const key_type& k)
+    {
+        iterator it = end();
+        if( empty() )
+        {
+            return it;
+        }
+
         value_type val;
         val.first = k;
 
         size_t ip = 0;
         key_iterator kit;
-        for(node_ptr p = _root; p->key_count(); p = p->sub()[ip])
+        for(node_type* p = _root.get(); ; p = p->sub()[ip].get())
         {
             kit = p->locate(val);
             ip = kit - p->first_key();
+            it.push(p, ip);
             if( kit != p->last_key() && kvcomp::equal(val, *kit) )
             {
-                return iterator(p, ip);
+                return it;
+            }
+
+            if( p->is_leaf() ){ break; }
+        }
+
+        // past the last key of the leaf, the next key is in an ancestor
+        while( it._depth && it.top().node->key_count() <= it.top().pos )
+        {
+            --it._depth;
+        }
+        return it;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    typename btree<K, V, Order, Aggregate, Encoding>::iterator btree<K, V, Order, Aggregate, Encoding>::floor(const key_type& k)
+    {
+        iterator it = end();
+        if( empty() )
+        {
+            return it;
+        }
+
+        value_type val;
+        val.first = k;
+
+        // the last key not greater than k met on the way down, the deepest
+        // one is the closest
+        size_t depth = 0, pos = 0;
+        node_type* p = _root.get();
+        for(;;)
+        {
+            size_t g = p->locate_upper(val) - p->first_key();
+            it.push(p, g);
+            if( g )
+            {
+                depth = it._depth;
+                pos   = g - 1;
+                if( !kvcomp::less(p->key()[pos], val) )
+                {
+                    break; // k itself
+                }
             }
 
             if( p->is_leaf() ){ break; }
+            p = p->sub()[g].get();
+        }
+
+        if( !depth )
+        {
+            return end();
+        }
+        it._depth = depth;
+        it.top().pos = pos;
+        return it;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    template<typename InputIterator>
+    void btree<K, V, Order, Aggregate, Encoding>::assign_sorted(InputIterator first, size_t count)
+    {
+        // a subtree of height h holds at most Order^(h+1) - 1 keys
+        size_t height = 0;
+        for(size_t capacity = Order - 1; capacity < count; capacity = higher(capacity))
+        {
+            ++height;
+        }
+
+        _root = build(first, count, height);
+        _rightmost.reset();
+        _size = count;
+        ++_epoch;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    template<typename InputIterator>
+    typename btree<K, V, Order, Aggregate, Encoding>::node_ptr btree<K, V, Order, Aggregate, Encoding>::build(InputIterator& it, size_t count, size_t height)
+    {
+        // an input which fails midway stops the build, the caller drops
+        // the partial tree
+        using btree_helper::input_failed;
+
+        node_ptr p(new node_type());
+        if( !height )
+        {
+            p->key().reserve(std::min<size_t>(count, Order - 1));
+            for(; count && !input_failed(it); --count, ++it)
+            {
+                p->key().push_back(*it);
+            }
+            p->update_aggregate();
+            return p;
+        }
+
+        size_t capacity = Order - 1;
+        for(size_t h = 1; h < height; ++h)
+        {
+            capacity = higher(capacity);
+        }
+
+        // use as few subtrees as possible, and spread keys evenly among them
+        size_t subs = count / (capacity + 1) + 1;
+        if( subs < 2 )
+        {
+            subs = 2;
+        }
+
+        size_t share = (count - (subs - 1)) / subs;
+        size_t extra = (count - (subs - 1)) % subs;
+        p->key().reserve(subs - 1);
+        p->sub().reserve(subs);
+        for(size_t n = 0; n < subs && !input_failed(it); ++n)
+        {
+            p->sub().push_back(build(it, share + (n < extra ? 1 : 0), height - 1));
+            if( n + 1 < subs )
+            {
+                p->key().push_back(*it);
+                ++it;
+            }
+        }
+        p->update_aggregate();
+        return p;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    typename btree<K, V, Order, Aggregate, Encoding>::aggregate_type
+    btree<K, V, Order, Aggregate, Encoding>::aggregate(const node_ptr& p, const key_type* lo, const key_type* hi)
+    {
+        if( !lo && !hi )
+        {
+            return p->aggregate();
+        }
+
+        // keys [first, last) of current node fall in [lo, hi)
+        value_type val;
+        size_t first = 0, last = p->key_count();
+        if( lo )
+        {
+            val.first = *lo;
+            first = p->locate(val) - p->first_key();
+        }
+        if( hi )
+        {
+            val.first = *hi;
+            last = p->locate(val) - p->first_key();
+        }
+
+        if( last < first )
+        {
+            return Aggregate::identity();
+        }
+
+        bool leaf = p->is_leaf();
+        if( !leaf && first == last )
+        {
+            return aggregate(p->sub()[first], lo, hi);
+        }
+
+        // only the two boundary subtrees are partially covered
+        aggregate_type a = leaf ? Aggregate::identity() : aggregate(p->sub()[first], lo, nullptr);
+        for(size_t n = first; n < last; ++n)
+        {
+            a = Aggregate::combine(a, Aggregate::of(p->key()[n].second));
+            if( !leaf )
+            {
+                a = Aggregate::combine(a, n + 1 < last ? p->sub()[n+1]->aggregate()
+                                                       : aggregate(p->sub()[last], nullptr, hi));
+            }
+        }
+        return a;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    template<typename Function>
+    void btree<K, V, Order, Aggregate, Encoding>::parallel_for_each(const key_type* lo, const key_type* hi,
+                                                          Function& fn, size_t threads)
+    {
+        if( !threads )
+        {
+            threads = 1;
+        }
+
+        work_list items;
+        collect(_root, lo, hi, items);
+
+        // Refine whole subtrees into their children until there are enough
+        // items to balance the partitions.
+        for(bool refined = true; refined && items.size() < 32 * threads; )
+        {
+            refined = false;
+            work_list finer;
+            for(size_t i = 0; i < items.size(); ++i)
+            {
+                const work_item& w = items[i];
+                if( w.key != work_item::subtree || w.node->is_leaf() )
+                {
+                    finer.push_back(w);
+                    continue;
+                }
+
+                refined = true;
+                size_t count = w.node->key_count();
+                for(size_t k = 0; k <= count; ++k)
+                {
+                    finer.push_back(work_item(w.node->sub()[k], work_item::subtree, estimate(w.node->sub()[k])));
+                    if( k < count )
+                    {
+                        finer.push_back(work_item(w.node, k, 1));
+                    }
+                }
+            }
+            items.swap(finer);
+        }
+
+        size_t total = 0;
+        for(size_t i = 0; i < items.size(); ++i)
+        {
+            total += items[i].weight;
+        }
+
+        // cut the ordered items into contiguous partitions of similar weight
+        std::vector<size_t> bounds(1, 0);
+        size_t weight = 0;
+        for(size_t i = 0; i < items.size() && bounds.size() < threads; ++i)
+        {
+            weight += items[i].weight;
+            if( weight * threads >= total * bounds.size() )
+            {
+                bounds.push_back(i + 1);
+            }
+        }
+        bounds.resize(threads + 1, items.size());
+
+        auto worker = [&](size_t n)
+        {
+            for(size_t i = bounds[n]; i < bounds[n+1]; ++i)
+            {
+                const work_item& w = items[i];
+                if( w.key == work_item::subtree )
+                {
+                    visit(w.node, n, fn);
+                }
+                else
+                {
+                    fn(n, w.node->key()[w.key]);
+                }
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for(size_t n = 1; n < threads; ++n)
+        {
+            pool.push_back(std::thread(worker, n));
+        }
+        worker(0);
+        for(size_t n = 0; n < pool.size(); ++n)
+        {
+            pool[n].join();
         }
-        return end();
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree<K, V, Order, Aggregate, Encoding>::collect(const node_ptr& p, const key_type* lo, const key_type* hi, work_list& items)
+    {
+        if( !lo && !hi )
+        {
+            if( p->key_count() )
+            {
+                items.push_back(work_item(p, work_item::subtree, estimate(p)));
+            }
+            return;
+        }
+
+        // keys [first, last) of current node fall in [lo, hi), the same as
+        // aggregate(), only the two boundary subtrees are partially covered
+        value_type val;
+        size_t first = 0, last = p->key_count();
+        if( lo )
+        {
+            val.first = *lo;
+            first = p->locate(val) - p->first_key();
+        }
+        if( hi )
+        {
+            val.first = *hi;
+            last = p->locate(val) - p->first_key();
+        }
+
+        if( last < first )
+        {
+            return;
+        }
+
+        bool leaf = p->is_leaf();
+        if( !leaf && first == last )
+        {
+            return collect(p->sub()[first], lo, hi, items);
+        }
+
+        if( !leaf )
+        {
+            collect(p->sub()[first], lo, nullptr, items);
+        }
+        for(size_t n = first; n < last; ++n)
+        {
+            items.push_back(work_item(p, n, 1));
+            if( !leaf )
+            {
+                collect(p->sub()[n+1], nullptr, n + 1 < last ? nullptr : hi, items);
+            }
+        }
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    size_t btree<K, V, Order, Aggregate, Encoding>::estimate(const node_ptr& p)
+    {
+        // every subtree is assumed as large as the leftmost one
+        size_t count = p->key_count();
+        return p->is_leaf() ? count : count + (count + 1) * estimate(p->sub().front());
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    template<typename Function>
+    void btree<K, V, Order, Aggregate, Encoding>::visit(const node_ptr& p, size_t n, Function& fn)
+    {
+        size_t count = p->key_count();
+        if( p->is_leaf() )
+        {
+            for(size_t k = 0; k < count; ++k)
+            {
+                fn(n, p->key()[k]);
+            }
+            return;
+        }
+
+        for(size_t k = 0; k < count; ++k)
+        {
+            visit(p->sub()[k], n, fn);
+            fn(n, p->key()[k]);
+        }
+        visit(p->sub()[count], n, fn);
     }
 }
+
+#include "frozen_btree.h"
+#include "packed_btree.h"
+#include "btree_serialize.h"
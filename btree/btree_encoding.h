@@ -0,0 +1,493 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+#include "btree_helper.h"
+
+namespace btree_helper
+{
+    // Encodings of the pairs of btree nodes, the Encoding parameter of
+    // algo::btree. keyvalues<K, V>::type is the array of pairs of a node.
+
+    // Pairs are stored as they are
+    class plain_encoding
+    {
+    public:
+        template<typename K, typename V>
+        class keyvalues
+        {
+        public:
+            typedef std::vector<std::pair<K, V> > type;
+        };
+    };
+
+    template<typename K, typename V>
+    class delta_keyvalues;
+
+    // Integer keys are stored as offsets from the first key of their node,
+    // see delta_keyvalues. Iterators give proxies of the pairs.
+    class delta_encoding
+    {
+    public:
+        template<typename K, typename V>
+        class keyvalues
+        {
+        public:
+            typedef delta_keyvalues<K, V> type;
+        };
+    };
+
+    // Proxy of a pair of delta_keyvalues, a copy of the key and a reference
+    // to the value, which is const for read-only access
+    template<typename K, typename V>
+    class delta_pair
+    {
+    public:
+        typedef std::pair<K, typename std::remove_const<V>::type> value_type;
+
+        delta_pair(const K& k, V& v): first(k), second(v) {}
+
+        // read-only proxy from a writable one
+        template<typename W>
+        delta_pair(const delta_pair<K, W>& p): first(p.first), second(p.second) {}
+
+        operator value_type() const { return value_type(first, second); }
+
+        const K first;
+        V&      second;
+    };
+
+    // What operator-> of an iterator over proxies returns
+    template<typename Pair>
+    class delta_arrow
+    {
+    public:
+        delta_arrow(const Pair& p): _p(p) {}
+
+        template<typename Other>
+        delta_arrow(const delta_arrow<Other>& a): _p(*a.operator->()) {}
+
+        const Pair* operator->() const { return &_p; }
+
+    private:
+        Pair _p;
+    };
+
+    // Integer keys stored as offsets from a base key, in bytes holding 1, 2,
+    // 4 or 8 bytes each, the width. Shared by delta_keyvalues and
+    // packed_btree.
+    template<typename K>
+    class key_offsets
+    {
+    public:
+        typedef typename std::make_unsigned<K>::type offset_type;
+
+        // the narrowest width that fits offset t
+        static unsigned char width_of(offset_type t)
+        {
+            return t <= 0xff ? 1 : t <= 0xffff ? 2 : t <= 0xffffffffu ? 4 : 8;
+        }
+
+        static offset_type load(const unsigned char* d, unsigned char width)
+        {
+            switch( width )
+            {
+            case 1:  return offset_type(load<unsigned char>(d));
+            case 2:  return offset_type(load<unsigned short>(d));
+            case 4:  return offset_type(load<unsigned int>(d));
+            default: return offset_type(load<unsigned long long>(d));
+            }
+        }
+
+        static void store(unsigned char* d, unsigned char width, offset_type t)
+        {
+            switch( width )
+            {
+            case 1:  store<unsigned char>(d, t);      break;
+            case 2:  store<unsigned short>(d, t);     break;
+            case 4:  store<unsigned int>(d, t);       break;
+            default: store<unsigned long long>(d, t); break;
+            }
+        }
+
+        // number of the n offsets at d less (not greater if upper) than t
+        static size_t count(const unsigned char* d, size_t n, unsigned char width, offset_type t, bool upper)
+        {
+            switch( width )
+            {
+            case 1:  return count<unsigned char>(d, n, t, upper);
+            case 2:  return count<unsigned short>(d, n, t, upper);
+            case 4:  return count<unsigned int>(d, n, t, upper);
+            default: return count<unsigned long long>(d, n, t, upper);
+            }
+        }
+
+    private:
+        // offsets are bytes, read and written through memcpy as they are no T
+        template<typename T>
+        static void store(unsigned char* d, offset_type t) { T v = T(t); std::memcpy(d, &v, sizeof(T)); }
+
+        template<typename T>
+        static T load(const unsigned char* d) { T v; std::memcpy(&v, d, sizeof(T)); return v; }
+
+        template<typename T>
+        static size_t count(const unsigned char* d, size_t n, offset_type t, bool upper)
+        {
+            // offsets larger than any of this width are greater than all of them
+            if( t > offset_type(T(-1)) )
+            {
+                return n;
+            }
+
+            T target = T(t);
+            size_t c = 0;
+            if( upper )
+            {
+                for(size_t i = 0; i < n; ++i)
+                {
+                    c += load<T>(d + i * sizeof(T)) <= target;
+                }
+            }
+            else
+            {
+                for(size_t i = 0; i < n; ++i)
+                {
+                    c += load<T>(d + i * sizeof(T)) < target;
+                }
+            }
+            return c;
+        }
+    };
+
+    // Pairs of a node with integer keys, ordered by key. Keys are stored as
+    // offsets from the first one, all in the narrowest of 1, 2, 4 or 8 bytes
+    // that fits the last one, values in an array apart. A key inserted
+    // before the first one, or one whose offset does not fit, re-encodes
+    // the node, as does removing the first or the last key, so offsets are
+    // always as narrow as they can be. Search counts the offsets less than
+    // the target in a loop without branches, which compilers vectorize.
+    template<typename K, typename V>
+    class delta_keyvalues
+    {
+        static_assert(std::is_integral<K>::value, "delta_encoding needs integer keys");
+
+    public:
+        typedef std::pair<K, V>                 value_type;
+        typedef delta_pair<K, V>                reference;
+        typedef delta_pair<K, const V>          const_reference;
+        typedef delta_arrow<reference>          pointer;
+        typedef delta_arrow<const_reference>    const_pointer;
+
+        // positions of pairs, enough for the btree code
+        class iterator
+        {
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef typename delta_keyvalues::value_type value_type;
+            typedef ptrdiff_t                       difference_type;
+            typedef typename delta_keyvalues::pointer   pointer;
+            typedef typename delta_keyvalues::reference reference;
+
+            iterator(): _v(nullptr), _n(0) {}
+            iterator(delta_keyvalues* v, size_t n): _v(v), _n(n) {}
+
+            reference operator* () const { return (*_v)[_n]; }
+
+            iterator& operator++() { ++_n; return *this; }
+            iterator& operator--() { --_n; return *this; }
+            iterator  operator+ (ptrdiff_t d) const { return iterator(_v, _n + d); }
+            ptrdiff_t operator- (const iterator& another) const { return ptrdiff_t(_n - another._n); }
+
+            bool operator== (const iterator& another) const { return _n == another._n; }
+            bool operator!= (const iterator& another) const { return _n != another._n; }
+
+        private:
+            friend class delta_keyvalues;
+
+            delta_keyvalues* _v;
+            size_t           _n;
+        };
+
+        delta_keyvalues(): _base(0), _width(1) {}
+
+        size_t size() const  { return _values.size(); }
+        bool   empty() const { return _values.empty(); }
+
+        void reserve(size_t n)
+        {
+            _offsets.reserve(n * _width);
+            _values.reserve(n);
+        }
+
+        void clear()
+        {
+            _offsets.clear();
+            _values.clear();
+            _width = 1;
+        }
+
+        K key(size_t n) const { return K(offset_type(_base) + offset(n)); }
+
+        reference       operator[] (size_t n)       { return reference(key(n), _values[n]); }
+        const_reference operator[] (size_t n) const { return const_reference(key(n), _values[n]); }
+
+        reference front() { return (*this)[0]; }
+        reference back()  { return (*this)[size() - 1]; }
+
+        iterator begin() { return iterator(this, 0); }
+        iterator end()   { return iterator(this, size()); }
+
+        // inserts val at position n, which keeps the keys in order
+        void insert(size_t n, const value_type& val);
+
+        void push_back(const value_type& val) { insert(size(), val); }
+        void pop_back()                       { erase(size() - 1, size()); }
+
+        // removes the pairs at positions [first, last)
+        void erase(size_t first, size_t last);
+
+        // appends the pairs of src at positions [first, last)
+        void append(const delta_keyvalues& src, size_t first, size_t last);
+
+        // position of the first pair whose key is not less (greater if upper) than k
+        size_t search(const K& k, bool upper) const;
+
+        // approximate number of bytes used by the pairs
+        size_t memory() const { return _offsets.capacity() + _values.capacity() * sizeof(V); }
+
+    private:
+        typedef key_offsets<K>                codec;
+        typedef typename codec::offset_type   offset_type;
+
+        offset_type offset(size_t n) const                  { return codec::load(&_offsets[n * _width], _width); }
+        void        set_offset(size_t n, offset_type t)     { codec::store(&_offsets[n * _width], _width, t); }
+
+        // stores the keys as offsets from base in the given width
+        void recode(K base, unsigned char width);
+
+        // re-encodes from the first key if the keys changed at either end
+        void shrink();
+
+        // makes room for count pairs, growing by a few pairs at a time
+        // rather than doubling, as nodes hardly ever fill up in one go
+        void grow(size_t count)
+        {
+            enum { step = 16 };
+            if( count > _values.capacity() )
+            {
+                size_t room = (count + step - 1) / step * step;
+                _values.reserve(room);
+                _offsets.reserve(room * _width);
+            }
+        }
+
+        std::vector<unsigned char> _offsets;
+        std::vector<V>             _values;
+        K                          _base;   // first key
+        unsigned char              _width;  // bytes per offset
+    };
+
+    template<typename K, typename V>
+    void delta_keyvalues<K, V>::recode(K base, unsigned char width)
+    {
+        std::vector<unsigned char> old;
+        old.swap(_offsets);
+        size_t        count     = _values.size();
+        K             old_base  = _base;
+        unsigned char old_width = _width;
+
+        _offsets.reserve(_values.capacity() * width);
+        _offsets.resize(count * width);
+        _base  = base;
+        _width = width;
+        for(size_t n = 0; n < count; ++n)
+        {
+            offset_type t = codec::load(&old[n * old_width], old_width);
+            set_offset(n, offset_type(old_base) + t - offset_type(base));
+        }
+    }
+
+    template<typename K, typename V>
+    void delta_keyvalues<K, V>::shrink()
+    {
+        if( empty() )
+        {
+            _width = 1;
+            return;
+        }
+
+        K first = key(0);
+        unsigned char width = codec::width_of(offset_type(key(size() - 1)) - offset_type(first));
+        if( first != _base || width != _width )
+        {
+            recode(first, width);
+        }
+    }
+
+    template<typename K, typename V>
+    void delta_keyvalues<K, V>::insert(size_t n, const value_type& val)
+    {
+        if( empty() )
+        {
+            _base  = val.first;
+            _width = 1;
+        }
+        else
+        {
+            // the keys will span from the least to the greatest of the first,
+            // the last and val
+            K first = n == 0 ? val.first : _base;
+            K last  = n == size() ? val.first : key(size() - 1);
+            unsigned char width = codec::width_of(offset_type(last) - offset_type(first));
+            if( first != _base || width > _width )
+            {
+                recode(first, width > _width ? width : _width);
+            }
+        }
+
+        grow(size() + 1);
+        _offsets.insert(_offsets.begin() + n * _width, _width, 0);
+        set_offset(n, offset_type(val.first) - offset_type(_base));
+        _values.insert(_values.begin() + n, val.second);
+    }
+
+    template<typename K, typename V>
+    void delta_keyvalues<K, V>::erase(size_t first, size_t last)
+    {
+        bool ends = first == 0 || last == size();
+        _offsets.erase(_offsets.begin() + first * _width, _offsets.begin() + last * _width);
+        _values.erase(_values.begin() + first, _values.begin() + last);
+        if( ends )
+        {
+            shrink();
+        }
+    }
+
+    template<typename K, typename V>
+    void delta_keyvalues<K, V>::append(const delta_keyvalues& src, size_t first, size_t last)
+    {
+        if( first == last )
+        {
+            return;
+        }
+
+        K lo = empty() ? src.key(first) : _base;
+        unsigned char width = codec::width_of(offset_type(src.key(last - 1)) - offset_type(lo));
+        if( empty() )
+        {
+            _base  = lo;
+            _width = width;
+        }
+        else if( width > _width )
+        {
+            recode(_base, width);
+        }
+
+        size_t count = size();
+        grow(count + last - first);
+        _offsets.resize((count + last - first) * _width);
+        for(size_t n = first; n < last; ++n)
+        {
+            set_offset(count + n - first, offset_type(src.key(n)) - offset_type(_base));
+        }
+        _values.insert(_values.end(), src._values.begin() + first, src._values.begin() + last);
+    }
+
+    template<typename K, typename V>
+    size_t delta_keyvalues<K, V>::search(const K& k, bool upper) const
+    {
+        if( empty() || k < _base )
+        {
+            return 0;
+        }
+
+        return codec::count(&_offsets[0], size(), _width, offset_type(k) - offset_type(_base), upper);
+    }
+
+    // The vector helpers of btree_helper.h for delta_keyvalues
+
+    template<typename K, typename V>
+    void insert(delta_keyvalues<K, V>& v, size_t p, const typename delta_keyvalues<K, V>::value_type& k)
+    {
+        v.insert(p, k);
+    }
+
+    template<typename K, typename V>
+    void erase(delta_keyvalues<K, V>& v, size_t p)
+    {
+        v.erase(p, p + 1);
+    }
+
+    template<typename K, typename V>
+    void erase_from(delta_keyvalues<K, V>& v, size_t p)
+    {
+        v.erase(p, v.size());
+    }
+
+    template<typename K, typename V>
+    void move(delta_keyvalues<K, V>& src, size_t p, delta_keyvalues<K, V>& dst)
+    {
+        dst.clear();
+        dst.append(src, p, src.size());
+        src.erase(p, src.size());
+    }
+
+    template<typename K, typename V>
+    void cut_paste_using_swap(delta_keyvalues<K, V>& src,
+                              typename delta_keyvalues<K, V>::iterator src_begin,
+                              typename delta_keyvalues<K, V>::iterator src_end,
+                              delta_keyvalues<K, V>& dst,
+                              typename delta_keyvalues<K, V>::iterator pos)
+    {
+        // the pairs after pos are set aside and appended again, a merge of
+        // nodes pastes at the end and has none
+        size_t first = src_begin - src.begin();
+        size_t last  = src_end - src.begin();
+        size_t at    = pos - dst.begin();
+        delta_keyvalues<K, V> tail;
+        if( at < dst.size() )
+        {
+            tail.append(dst, at, dst.size());
+            dst.erase(at, dst.size());
+        }
+        dst.append(src, first, last);
+        dst.append(tail, 0, tail.size());
+        src.erase(first, last);
+    }
+
+    template<typename K, typename V>
+    void take(delta_keyvalues<K, V>& v, size_t p, typename delta_keyvalues<K, V>::value_type& val)
+    {
+        val = v[p];
+        v.erase(p, p + 1);
+    }
+
+    template<typename K, typename V>
+    void put(delta_keyvalues<K, V>& v, size_t p, typename delta_keyvalues<K, V>::value_type& val)
+    {
+        v.insert(p, val);
+    }
+
+    template<typename K, typename V>
+    void exchange(delta_keyvalues<K, V>& v, size_t p, typename delta_keyvalues<K, V>::value_type& val)
+    {
+        typename delta_keyvalues<K, V>::value_type old = v[p];
+        v.erase(p, p + 1);
+        v.insert(p, val);
+        val = old;
+    }
+
+    template<typename K, typename V>
+    size_t locate(delta_keyvalues<K, V>& v, const typename delta_keyvalues<K, V>::value_type& val, bool upper)
+    {
+        return v.search(val.first, upper);
+    }
+
+    template<typename K, typename V>
+    typename delta_keyvalues<K, V>::pointer address(delta_keyvalues<K, V>& v, size_t p)
+    {
+        return v[p];
+    }
+}
@@ -1,4 +1,11 @@
 #pragma once
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <functional>
+#include <type_traits>
 
 namespace btree_helper
 {
@@ -15,32 +22,205 @@ namespace btree_helper
 
         static bool less(const value_type& lv, const value_type& rv)
         {
-            static std::less<K> pred;
-            return pred(lv.first, rv.first);
+            return key_less(lv.first, rv.first);
         }
 
         static bool equal(const value_type& lv, const value_type& rv)
         {
             return !less(lv, rv) && !less(rv, lv);
         }
+
+        static bool key_less(const K& l, const K& r)
+        {
+            static std::less<K> pred;
+            return pred(l, r);
+        }
+
+        static bool key_equal(const K& l, const K& r)
+        {
+            return !key_less(l, r) && !key_less(r, l);
+        }
+    };
+
+    // Hash of keys for the front cache of btree::find. Keys other than
+    // numbers, pointers and strings have none unless it is specialized for
+    // them, and find() runs without the cache.
+    template<typename K, typename Enable = void>
+    class cache_hash
+    {
+    public:
+        enum { enabled = 0 };
+
+        static size_t of(const K&) { return 0; }
+    };
+
+    template<typename K>
+    class cache_hash<K, typename std::enable_if<std::is_arithmetic<K>::value || std::is_pointer<K>::value>::type>
+    {
+    public:
+        enum { enabled = 1 };
+
+        static size_t of(const K& k) { return std::hash<K>()(k); }
+    };
+
+    template<>
+    class cache_hash<std::string>
+    {
+    public:
+        enum { enabled = 1 };
+
+        static size_t of(const std::string& k) { return std::hash<std::string>()(k); }
     };
 
     // Limits on a btree node
     // #key should be in range [key_lower, key_upper)
     // #sub should be in range [sub_lower, key_upper)
+    // The root, and nodes on the right edge split by appends, may hold fewer.
+    // Top-down updates split full nodes and merge two nodes having key_lower
+    // keys plus their separator, which needs 2 * key_lower + 1 < key_upper.
+    // A full node of order 3 can not be split, it is updated bottom-up.
+    // max_depth bounds the height of a tree holding fewer than 2^48 keys, more
+    // than fit in memory. Below the root, nodes off the right edge have at
+    // least sub_lower subtrees, 2^sub_bits or more.
     template<size_t Order>
     class btree_order_limits
     {
     public:
         enum
         {
-            key_lower = Order / 2,
+            top_down  = Order >= 4,
+            key_lower = top_down ? (Order - 2) / 2 : (Order - 1) / 2,
             key_upper = Order,
             sub_lower = key_lower + 1,
             sub_upper = key_upper + 1,
+            sub_bits  = sub_lower >= 256 ? 8 : sub_lower >= 16 ? 4 : sub_lower >= 4 ? 2 : 1,
+            max_depth = 48 / sub_bits + 2,
         };
     };
 
+    // Aggregates cached by btree nodes for their subtrees.
+    // An aggregate is a monoid over values: identity() is the neutral element,
+    // of() lifts a value and combine() is associative.
+    template<typename V>
+    class no_aggregate
+    {
+    public:
+        class aggregate_type {};
+        enum { enabled = 0 };
+
+        static aggregate_type identity()                                        { return aggregate_type(); }
+        static aggregate_type of(const V&)                                      { return aggregate_type(); }
+        static aggregate_type combine(const aggregate_type&, const aggregate_type&) { return aggregate_type(); }
+    };
+
+    template<typename V>
+    class sum_aggregate
+    {
+    public:
+        typedef V aggregate_type;
+        enum { enabled = 1 };
+
+        static V identity()                         { return V(); }
+        static V of(const V& v)                     { return v; }
+        static V combine(const V& l, const V& r)    { return l + r; }
+    };
+
+    template<typename V>
+    class count_aggregate
+    {
+    public:
+        typedef size_t aggregate_type;
+        enum { enabled = 1 };
+
+        static size_t identity()                            { return 0; }
+        static size_t of(const V&)                          { return 1; }
+        static size_t combine(const size_t& l, const size_t& r) { return l + r; }
+    };
+
+    template<typename V>
+    class min_aggregate
+    {
+    public:
+        typedef V aggregate_type;
+        enum { enabled = 1 };
+
+        static V identity()                         { return std::numeric_limits<V>::max(); }
+        static V of(const V& v)                     { return v; }
+        static V combine(const V& l, const V& r)    { return r < l ? r : l; }
+    };
+
+    template<typename V>
+    class max_aggregate
+    {
+    public:
+        typedef V aggregate_type;
+        enum { enabled = 1 };
+
+        static V identity()                         { return std::numeric_limits<V>::lowest(); }
+        static V of(const V& v)                     { return v; }
+        static V combine(const V& l, const V& r)    { return l < r ? r : l; }
+    };
+
+    // Reader-writer spin lock for short critical sections.
+    // A waiting writer blocks new readers, so writers are not starved.
+    class rw_lock
+    {
+    public:
+        rw_lock(): _state(0) {}
+
+        void lock_shared()
+        {
+            for(;;)
+            {
+                unsigned s = _state.load();
+                if( !(s & writer) && _state.compare_exchange_weak(s, s + 1) )
+                {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        void unlock_shared() { _state.fetch_sub(1); }
+
+        void lock()
+        {
+            for(;;)
+            {
+                unsigned s = _state.load();
+                if( !(s & writer) && _state.compare_exchange_weak(s, s | writer) )
+                {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+
+            // wait for the readers to leave
+            while( _state.load() != writer )
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        void unlock() { _state.store(0); }
+
+    private:
+        rw_lock(const rw_lock&);
+        rw_lock& operator= (const rw_lock&);
+
+        enum { writer = 0x80000000u };
+
+        std::atomic<unsigned> _state; // writer bit and number of readers
+    };
+
+    // Tells btree::build to stop. Input iterators which may fail midway,
+    // such as the one reading a saved tree, overload it.
+    template<typename InputIterator>
+    bool input_failed(const InputIterator&)
+    {
+        return false;
+    }
+
     // See btree google code for why this swap
     template<typename T>
     void swap(T& l, T& r)
@@ -78,6 +258,48 @@ namespace btree_helper
         v.erase(v.begin()+p);
     }
 
+    // Move v[p] to val and remove it from v
+    template<typename Vector>
+    void take(Vector& v, size_t p, typename Vector::value_type& val)
+    {
+        btree_helper::swap(v[p], val);
+        btree_helper::erase(v, p);
+    }
+
+    // Move val into v at p
+    template<typename Vector>
+    void put(Vector& v, size_t p, typename Vector::value_type& val)
+    {
+        typename Vector::value_type tmp;
+        btree_helper::insert(v, p, tmp);
+        btree_helper::swap(v[p], val);
+    }
+
+    // Exchange v[p] and val, which falls in the same place of the order
+    template<typename Vector>
+    void exchange(Vector& v, size_t p, typename Vector::value_type& val)
+    {
+        btree_helper::swap(v[p], val);
+    }
+
+    // position of the first pair whose key is not less (greater if upper)
+    // than that of val
+    template<typename Vector>
+    size_t locate(Vector& v, const typename Vector::value_type& val, bool upper)
+    {
+        typedef typename Vector::value_type value_type;
+        typedef compare<typename value_type::first_type, typename value_type::second_type> kvcomp;
+
+        return (upper ? std::upper_bound(v.begin(), v.end(), val, kvcomp())
+                      : std::lower_bound(v.begin(), v.end(), val, kvcomp())) - v.begin();
+    }
+
+    template<typename Vector>
+    typename Vector::pointer address(Vector& v, size_t p)
+    {
+        return &v[p];
+    }
+
     template<typename Vector>
     void erase_from(Vector& v, size_t p)
     {
@@ -0,0 +1,141 @@
+#pragma once
+#include <limits>
+#include <utility>
+#include <iterator>
+
+#include "btree.h"
+
+namespace algo
+{
+    // Ordered map allowing duplicate keys, on top of a btree keyed by pairs
+    // of a key and an insertion number. Duplicates are stored inline in the
+    // nodes like distinct keys, in insertion order. Every node counts the
+    // pairs of its subtree, thus count() takes O(log n) for any number of
+    // duplicates.
+    template<typename K, typename V, size_t Order>
+    class btree_multimap
+    {
+    public:
+        typedef btree_multimap<K, V, Order>  my_type;
+        typedef std::pair<K, V>              value_type;
+        typedef K                            key_type;
+
+    private:
+        typedef std::pair<K, size_t>                                          tree_key;
+        typedef btree<tree_key, V, Order, btree_helper::count_aggregate<V> >  tree_type;
+        typedef typename tree_type::iterator                                  tree_iterator;
+
+    public:
+        // Dereferencing an iterator gives the key and a reference to the value
+        class iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef std::pair<K, V>           value_type;
+            typedef ptrdiff_t                 difference_type;
+            typedef std::pair<const K&, V&>   reference;
+
+            class pointer
+            {
+            public:
+                pointer(const reference& r): _r(r) {}
+                const reference* operator->() const { return &_r; }
+            private:
+                reference _r;
+            };
+
+            iterator() {}
+
+            reference operator* () { return reference(_it->first.first, _it->second); }
+            pointer   operator->() { return pointer(**this); }
+
+            iterator& operator++() { ++_it; return *this; }
+
+            bool operator== (const iterator& another) const { return _it == another._it; }
+            bool operator!= (const iterator& another) const { return _it != another._it; }
+
+        private:
+            friend class btree_multimap;
+
+            iterator(const tree_iterator& it): _it(it) {}
+
+            tree_iterator _it;
+        };
+
+        btree_multimap(): _next(0) {}
+
+        // insert a key-value pair after all pairs with the same key
+        void insert(const value_type& val)
+        {
+            _tree.insert(std::make_pair(tree_key(val.first, _next++), val.second));
+        }
+
+        // erase the earliest inserted pair with key k, returns false if there is none
+        bool erase_one(const key_type& k);
+
+        // erase all pairs with key k, returns the number of erased pairs
+        size_t erase(const key_type& k);
+
+        bool   empty() const { return _tree.empty(); }
+        size_t size() const  { return _tree.size(); }
+
+        // number of pairs with key k
+        size_t count(const key_type& k) const
+        {
+            return _tree.aggregate(tree_key(k, 0), tree_key(k, std::numeric_limits<size_t>::max()));
+        }
+
+        iterator begin() { return iterator(_tree.begin()); }
+        iterator end()   { return iterator(_tree.end()); }
+
+        // Find the earliest inserted pair with key k
+        iterator find(const key_type& k)
+        {
+            iterator it = lower_bound(k);
+            return it != end() && !(k < it->first) ? it : end();
+        }
+
+        // Find the first pair whose key is not less than k
+        iterator lower_bound(const key_type& k) { return iterator(_tree.lower_bound(tree_key(k, 0))); }
+
+        // Find the first pair whose key is greater than k
+        iterator upper_bound(const key_type& k)
+        {
+            return iterator(_tree.lower_bound(tree_key(k, std::numeric_limits<size_t>::max())));
+        }
+
+        // pairs with key k, in insertion order
+        std::pair<iterator, iterator> equal_range(const key_type& k)
+        {
+            return std::make_pair(lower_bound(k), upper_bound(k));
+        }
+
+    private:
+        tree_type _tree;
+        size_t    _next;  // insertion number of the next pair
+    };
+
+    template<typename K, typename V, size_t Order>
+    bool btree_multimap<K, V, Order>::erase_one(const key_type& k)
+    {
+        tree_iterator it = _tree.lower_bound(tree_key(k, 0));
+        if( it == _tree.end() || k < it->first.first )
+        {
+            return false;
+        }
+
+        _tree.erase(it->first);
+        return true;
+    }
+
+    template<typename K, typename V, size_t Order>
+    size_t btree_multimap<K, V, Order>::erase(const key_type& k)
+    {
+        size_t erased = 0;
+        while( erase_one(k) )
+        {
+            ++erased;
+        }
+        return erased;
+    }
+}
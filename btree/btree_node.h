@@ -5,40 +5,43 @@
 #include <iostream>
 
 #include "btree_helper.h"
+#include "btree_encoding.h"
 
 namespace algo
 {
-    template<typename K, typename V, size_t Order>
+    template<typename K, typename V, size_t Order, typename Aggregate = btree_helper::no_aggregate<V>,
+             typename Encoding = btree_helper::plain_encoding>
     class btree;
 
-    template<typename K, typename V, size_t Order>
+    // Node of a b-tree.
+    // Insertion and removal work top-down in a single pass: a full subtree is
+    // split before stepping into it, and a subtree at the lower limit gets a
+    // key from a sibling (or is merged with it) before stepping into it, thus
+    // nodes need no pointers to their parents. Nodes of order 3 are too small
+    // to be split while full, they are split or fixed as the recursion returns.
+    // Encoding selects how the pairs of a node are stored, see
+    // btree_encoding.h. Pairs are accessed through keyvalue_v::reference.
+    template<typename K, typename V, size_t Order, typename Aggregate = btree_helper::no_aggregate<V>,
+             typename Encoding = btree_helper::plain_encoding>
     class btree_node
-        : public std::enable_shared_from_this<btree_node<K, V, Order> >
     {
     public:
-        typedef btree_node<K, V, Order>                 my_type;
-        typedef std::pair<K, V>                         value_type;
-        typedef K                                       key_type;
-        typedef std::shared_ptr<my_type>                shptr;
-        typedef std::weak_ptr<my_type>                  wkptr;
-        typedef std::vector<value_type>                 keyvalue_v;
-        typedef std::vector<shptr>                      subtree_v;
-        typedef typename keyvalue_v::iterator           key_iterator;
-        typedef typename subtree_v::iterator            tree_iterator;
-        typedef btree_helper::btree_order_limits<Order> limits;
-
-        btree_node(): _selfpos(-1) {}
-
-        // retrieve std::shared_ptr version of this pointer
-        shptr         thisptr()                     { return shared_from_this(); }
-
-        // get/set pointer to parent node, nullptr for root node
-        shptr         get_parent() const            { return _parent.lock(); }
-        void          set_parent(shptr parent)      { _parent = parent; }
-
-        // get/set the position of current node
-        size_t        get_selfpos() const           { return _selfpos; }
-        void          set_selfpos(size_t p)         { _selfpos = p; }
+        typedef btree_node<K, V, Order, Aggregate, Encoding> my_type;
+        typedef std::pair<K, V>                              value_type;
+        typedef K                                            key_type;
+        typedef typename Aggregate::aggregate_type           aggregate_type;
+        typedef std::shared_ptr<my_type>                     shptr;
+        typedef typename Encoding::template keyvalues<K, V>::type keyvalue_v;
+        typedef std::vector<shptr>                           subtree_v;
+        typedef typename keyvalue_v::iterator                key_iterator;
+        typedef typename subtree_v::iterator                 tree_iterator;
+        typedef typename keyvalue_v::reference               reference;
+        typedef typename keyvalue_v::const_reference         const_reference;
+        typedef typename keyvalue_v::pointer                 pointer;
+        typedef typename keyvalue_v::const_pointer           const_pointer;
+        typedef btree_helper::btree_order_limits<Order>      limits;
+
+        btree_node(): _aggregate(Aggregate::identity()) {}
 
         // keys stored in current node
         keyvalue_v&   key()                         { return _keyvalues; }
@@ -54,417 +57,358 @@ namespace algo
         tree_iterator first_child()                 { return _subtrees.begin(); }
         tree_iterator last_child()                  { return _subtrees.end(); }
 
-        // left side sibling node, which has the same parent with current node
-        shptr left_sibling() const
-        {
-            shptr lsibling;
-            if( !is_root() && _selfpos != 0 )
-            {
-                shptr pa = get_parent();
-                lsibling = pa->sub()[_selfpos-1];
-            }
-            return lsibling;
-        }
-
-        // right side sibling node, which has the same parent with current node
-        shptr right_sibling() const
-        {
-            shptr rsibling;
-            if( !is_root() )
-            {
-                shptr pa = get_parent();
-                if( pa->sub().size() > _selfpos+1 )
-                {
-                    rsibling = pa->sub()[_selfpos+1];
-                }
-            }
-            return rsibling;
-        }
+        // aggregate of all values stored in the subtree rooted at current node
+        const aggregate_type& aggregate() const     { return _aggregate; }
 
         // Tests whether current node is leaf node
         bool is_leaf() const { return _subtrees.empty(); }
 
-        // Tests whether current node is root node
-        bool is_root() const { return _selfpos == -1; }
+        // Tests whether current node can not take one more key
+        bool is_full() const { return _keyvalues.size() + 1 >= limits::key_upper; }
 
         // Number of keys stored in current node
         size_t key_count() const { return _keyvalues.size(); }
 
-        void insert(const value_type& val);
+        // Inserts val into the subtree rooted at current node, which must not
+        // be full unless the order is 3. Returns false if the key existed.
+        // append: val is greater than all keys of the tree, so bias the splits
+        //  to leave the left nodes as full as possible
+        bool insert(const value_type& val, bool append = false);
 
-        void remove(const value_type& val);
+        // Removes val from the subtree rooted at current node, returns false
+        // if it is not found
+        bool remove(const value_type& val);
 
         void swap(my_type& another);
 
         key_iterator locate(const value_type& val)
         {
-            return std::lower_bound(first_key(), last_key(), val, kvcomp());
+            return first_key() + btree_helper::locate(_keyvalues, val, false);
+        }
+
+        // the first key greater than val
+        key_iterator locate_upper(const value_type& val)
+        {
+            return first_key() + btree_helper::locate(_keyvalues, val, true);
         }
 
     private:
         typedef btree_helper::compare<K, V> kvcomp;
 
         void insert_key(size_t p, const value_type& val);
-        void insert_child(size_t p, shptr node);
+        void insert_child(size_t p, shptr node)     { btree_helper::insert(_subtrees, p, node); }
         void erase_key_at(size_t p)                 { btree_helper::erase(_keyvalues, p); }
-        void erase_child_at(size_t p);
+        void erase_child_at(size_t p)               { btree_helper::erase(_subtrees, p); }
         void erase_key_from(size_t p)               { btree_helper::erase_from(_keyvalues, p); }
-        void update_subtree(size_t p = 0);
-        void split();
-        bool rotate_left();
-        bool rotate_right();
 
-        // pop max key and rebalance
-        void pop_max_key(value_type& m);
+        // Splits n-th subtree into two, the median moves up to current node
+        void split_child(size_t n, bool append);
+
+        // Gives n-th subtree one more key, from a sibling by rotation or by
+        // merging it with a sibling. Returns false if there is no sibling.
+        bool fix_child(size_t n);
 
-        // pop min key and rebalance
+        // Moves the first key of (n+1)-th subtree to n-th subtree through
+        // the separator
+        void rotate_left(size_t n);
+
+        // Moves the last key of (n-1)-th subtree to n-th subtree through
+        // the separator
+        void rotate_right(size_t n);
+
+        // pop min key of the subtree rooted at current node
         void pop_min_key(value_type& m);
 
         // Merges n-th subtree and (n+1)-th subtree of current node
         void merge(size_t n);
 
-        // Remove the n-th key from current node
-        // removing a key should be in company with removing a child
-        void remove_n(size_t n);
+        // Recompute the aggregate of current node from its keys and subtrees
+        void update_aggregate();
 
-        // Rebalance the tree starting from current node
-        void rebalance();
-
-        template<typename, typename, size_t>
+        template<typename, typename, size_t, typename, typename>
         friend class btree;
 
     private:
-        wkptr      _parent;
-        size_t     _selfpos;
         keyvalue_v _keyvalues;
         subtree_v  _subtrees;
+
+        aggregate_type _aggregate;
     };
 
-    template<typename K, typename V, size_t Order>
-    bool btree_node<K, V, Order>::rotate_left()
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree_node<K, V, Order, Aggregate, Encoding>::update_aggregate()
     {
-        shptr rsibling(nullptr);
-        shptr parent = get_parent();
-        if( parent && parent->key_count() > _selfpos )
-        {
-            rsibling = parent->sub()[_selfpos+1];
-        }
-
-        if( !rsibling || rsibling->key_count() <= limits::key_lower )
+        if( !Aggregate::enabled )
         {
-            // no enough element for rotation
-            return false;
+            return;
         }
 
-        // separator from parent
-        value_type& s = parent->key()[_selfpos];
-
-        value_type tmp;
-        key().push_back(tmp);
-        btree_helper::swap(key().back(), s);
-        btree_helper::swap(rsibling->key().front(), s);
-        rsibling->erase_key_at(0);
-        if( !rsibling->is_leaf() )
+        // combine in key order, so the aggregate needs not be commutative
+        size_t count = _keyvalues.size();
+        aggregate_type a = is_leaf() ? Aggregate::identity() : _subtrees[0]->_aggregate;
+        for(size_t n = 0; n < count; ++n)
         {
-            shptr rsibling_sub = rsibling->sub()[0];
-            rsibling->erase_child_at(0);
-            insert_child(sub().size(), rsibling_sub);
+            a = Aggregate::combine(a, Aggregate::of(_keyvalues[n].second));
+            if( !is_leaf() )
+            {
+                a = Aggregate::combine(a, _subtrees[n+1]->_aggregate);
+            }
         }
-
-        rsibling->rebalance();
-        return true;
+        _aggregate = a;
     }
 
-    template<typename K, typename V, size_t Order>
-    bool btree_node<K, V, Order>::rotate_right()
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree_node<K, V, Order, Aggregate, Encoding>::rotate_left(size_t n)
     {
-        shptr lsibling(nullptr);
-        shptr parent = get_parent();
-        if( parent && _selfpos > 0 )
-        {
-            lsibling = parent->sub()[_selfpos-1];
-        }
-
-        if( !lsibling || lsibling->key_count() <= limits::key_lower )
+        shptr lsub = _subtrees[n];
+        shptr rsub = _subtrees[n+1];
+
+        // the first key of rsub replaces the separator, which moves to lsub
+        value_type s;
+        btree_helper::take(rsub->_keyvalues, 0, s);
+        btree_helper::exchange(_keyvalues, n, s);
+        btree_helper::put(lsub->_keyvalues, lsub->key_count(), s);
+        if( !rsub->is_leaf() )
         {
-            // no enough element for rotation
-            return false;
+            lsub->sub().push_back(rsub->sub().front());
+            rsub->erase_child_at(0);
         }
 
-        value_type& s = parent->key()[_selfpos-1];
+        lsub->update_aggregate();
+        rsub->update_aggregate();
+    }
 
-        value_type tmp;
-        insert_key(0, tmp);
-        btree_helper::swap(key().front(), s);
-        btree_helper::swap(lsibling->key().back(), s);
-        lsibling->key().pop_back();
-        if( !lsibling->is_leaf() )
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree_node<K, V, Order, Aggregate, Encoding>::rotate_right(size_t n)
+    {
+        shptr lsub = _subtrees[n-1];
+        shptr rsub = _subtrees[n];
+
+        // the last key of lsub replaces the separator, which moves to rsub
+        value_type s;
+        btree_helper::take(lsub->_keyvalues, lsub->key_count() - 1, s);
+        btree_helper::exchange(_keyvalues, n-1, s);
+        btree_helper::put(rsub->_keyvalues, 0, s);
+        if( !lsub->is_leaf() )
         {
-            shptr lsibling_sub = lsibling->sub().back();
-            lsibling->sub().pop_back();
-            insert_child(0, lsibling_sub);
+            rsub->insert_child(0, lsub->sub().back());
+            lsub->sub().pop_back();
         }
 
-        lsibling->rebalance();
-        return true;
+        lsub->update_aggregate();
+        rsub->update_aggregate();
     }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::insert_key(size_t p, const value_type& val)
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree_node<K, V, Order, Aggregate, Encoding>::insert_key(size_t p, const value_type& val)
     {
         btree_helper::insert(_keyvalues, p, val);
     }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::insert_child(size_t p, shptr node)
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    bool btree_node<K, V, Order, Aggregate, Encoding>::insert(const value_type& val, bool append)
     {
-        btree_helper::insert(_subtrees, p, node);
-        node->set_parent(thisptr());
-
-        size_t count = _subtrees.size();
-        for(; p < count; ++p)
+        size_t lb = locate(val) - first_key();
+        if( lb < key_count() && !kvcomp::less(val, _keyvalues[lb]) )
         {
-            _subtrees[p]->set_selfpos(p);
+            // in case the key already exists, just overwrite it
+            _keyvalues[lb].second = val.second;
+            update_aggregate();
+            return false;
         }
-    }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::erase_child_at(size_t p)
-    {
-        btree_helper::erase(_subtrees, p);
+        // insertion always occurs in a leaf node
+        if( is_leaf() )
+        {
+            insert_key(lb, val);
+            update_aggregate();
+            return true;
+        }
 
-        size_t count = _subtrees.size();
-        for(; p < count; ++p)
+        // split a full subtree before stepping into it, so that it has room
+        // for the median of any split below
+        if( limits::top_down && _subtrees[lb]->is_full() )
         {
-            _subtrees[p]->set_selfpos(p);
+            split_child(lb, append);
+            if( !kvcomp::less(val, _keyvalues[lb]) )
+            {
+                if( !kvcomp::less(_keyvalues[lb], val) )
+                {
+                    // the median is val itself
+                    _keyvalues[lb].second = val.second;
+                    update_aggregate();
+                    return false;
+                }
+                ++lb;
+            }
         }
-    }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::update_subtree(size_t p)
-    {
-        size_t count = _subtrees.size();
-        for(; p < count; ++p)
+        bool inserted = _subtrees[lb]->insert(val, append);
+
+        if( !limits::top_down && _subtrees[lb]->key_count() >= limits::key_upper )
         {
-            _subtrees[p]->set_parent(thisptr());
-            _subtrees[p]->set_selfpos(p);
+            split_child(lb, append);
         }
+        update_aggregate();
+        return inserted;
     }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::insert(const value_type& val)
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    bool btree_node<K, V, Order, Aggregate, Encoding>::remove(const value_type& val)
     {
-        size_t count = _keyvalues.size();
-        size_t lb = 0;
-        for(; lb < count; ++lb)
+        size_t lb = locate(val) - first_key();
+        bool found = lb < key_count() && !kvcomp::less(val, _keyvalues[lb]);
+
+        // if current node is a leaf node, just delete the key
+        // otherwise, step into child node
+        if( is_leaf() )
         {
-            if( kvcomp::less(val, _keyvalues[lb]) )
+            if( found )
             {
-                break;
-            }
-            else if( !kvcomp::less(_keyvalues[lb], val) )
-            {
-                // in case the key already exists, just overwrite it
-                _keyvalues[lb].second = val.second;
-                return;
+                erase_key_at(lb);
+                update_aggregate();
             }
+            return found;
         }
 
-        // insertion always occurs in a leaf node
-        // if current node is not a leaf node, step into subtree
-        if( !is_leaf() )
+        // a key found in an internal node is replaced by the minimum of its
+        // right subtree
+        size_t n = found ? lb + 1 : lb;
+
+        // make sure the subtree can lose a key before stepping into it,
+        // keys of current node may have moved, so search again
+        if( limits::top_down && _subtrees[n]->key_count() <= limits::key_lower && fix_child(n) )
         {
-            return _subtrees[lb]->insert(val);
+            return remove(val);
         }
 
-        // This is a leaf node, insert val
-        insert_key(lb, val);
-
-        // split current node, if needed
-        split();
-    }
-
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::remove(const value_type& val)
-    {
-        size_t count = _keyvalues.size();
-        size_t lb = 0;
-        for(; lb < count; ++lb)
+        bool removed = found;
+        if( found )
         {
-            if( kvcomp::less(val, _keyvalues[lb]) )
-            {
-                break;
-            }
-            else if( !kvcomp::less(_keyvalues[lb], val) )
-            {
-                return thisptr()->remove_n(lb);
-            }
+            value_type m;
+            _subtrees[n]->pop_min_key(m);
+            btree_helper::exchange(_keyvalues, lb, m);
+        }
+        else
+        {
+            removed = _subtrees[n]->remove(val);
         }
 
-        // if current node is not a leaf node, step into child node
-        // otherwise, val is not found
-        if( !is_leaf() )
+        if( !limits::top_down && _subtrees[n]->key_count() < limits::key_lower )
         {
-            return sub()[lb]->remove(val);
+            fix_child(n);
         }
+        update_aggregate();
+        return removed;
     }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::swap(my_type& another)
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree_node<K, V, Order, Aggregate, Encoding>::swap(my_type& another)
     {
-        std::swap(_parent, another._parent);
-        std::swap(_selfpos, another._selfpos);
         std::swap(_keyvalues, another._keyvalues);
         std::swap(_subtrees, another._subtrees);
-        update_subtree();
-        another.update_subtree();
+        std::swap(_aggregate, another._aggregate);
     }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::split()
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree_node<K, V, Order, Aggregate, Encoding>::split_child(size_t n, bool append)
     {
-        if( key_count() < limits::key_upper )
+        shptr lchild = _subtrees[n];
+        size_t count = lchild->key_count();
+
+        size_t break_pos = count / 2;
+        if( append && count > 2 )
         {
-            return; // no need to split
+            // sequential appends never come back to the left node, so keep it
+            // nearly full. A full leaf split ahead of the append moves nothing
+            // to the right node, the appended key goes there.
+            break_pos = count - (limits::top_down && lchild->is_leaf() ? 1 : 2);
         }
 
-        size_t break_pos = key_count() / 2;
-        
-        // get median
-        // median in _keyvalues is deleted later to avoid unnecessary move
-        value_type median;
-        btree_helper::swap(_keyvalues[break_pos], median);
-
-        // copy values after median to a new node
-        shptr parent = get_parent();
+        // move values after median to a new node
         shptr rchild(new my_type());
-        rchild->set_parent(parent);
-        rchild->set_selfpos(_selfpos);
-        btree_helper::move(_keyvalues, break_pos+1, rchild->_keyvalues);
-        btree_helper::move(_subtrees, break_pos+1, rchild->_subtrees);
-        rchild->update_subtree();
+        btree_helper::move(lchild->_keyvalues, break_pos+1, rchild->_keyvalues);
+        btree_helper::move(lchild->_subtrees, break_pos+1, rchild->_subtrees);
 
-        // delete dummy median place holder
-        _keyvalues.pop_back();
+        // the median is the last key of lchild now
+        value_type median;
+        btree_helper::take(lchild->_keyvalues, break_pos, median);
 
-        if( is_root() )
+        lchild->update_aggregate();
+        rchild->update_aggregate();
+        insert_key(n, median);
+        insert_child(n+1, rchild);
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    bool btree_node<K, V, Order, Aggregate, Encoding>::fix_child(size_t n)
+    {
+        size_t count = _subtrees.size();
+        if( count < 2 )
         {
-            // another new node is needed
-            shptr lchild(new my_type());
-            btree_helper::move(_keyvalues, 0, lchild->_keyvalues);
-            btree_helper::move(_subtrees, 0, lchild->_subtrees);
-            lchild->update_subtree();
-
-            insert_key(0, median);
-            insert_child(0, lchild);
-            insert_child(1, rchild);
-            return;
+            return false;
         }
 
-        parent->insert_key(_selfpos, median);
-        parent->insert_child(_selfpos+1, rchild);
-        parent->split();
+        // Try to balance the subtree by rotation. Otherwise merge it with the
+        // right sibling if there is one, or with the left sibling.
+        if( n + 1 < count && _subtrees[n+1]->key_count() > limits::key_lower )
+        {
+            rotate_left(n);
+        }
+        else if( n > 0 && _subtrees[n-1]->key_count() > limits::key_lower )
+        {
+            rotate_right(n);
+        }
+        else
+        {
+            merge(n + 1 < count ? n : n - 1);
+        }
+        return true;
     }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::remove_n(size_t n)
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree_node<K, V, Order, Aggregate, Encoding>::pop_min_key(value_type& m)
     {
-        // If current node is a leaf node, just delete the key and rebalance the tree
         if( is_leaf() )
         {
-            erase_key_at(n);
-            rebalance();
+            btree_helper::take(_keyvalues, 0, m);
+            update_aggregate();
             return;
         }
 
-        // Otherwise, shift the deletion to the right most leaf of left side subtree
-        // Or
-        //_subtrees[n]->move_max_to(_keyvalues[n]);
-        _subtrees[n+1]->pop_min_key(_keyvalues[n]);
-        
-    }
-
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::pop_min_key(value_type& m)
-    {
-        shptr p = thisptr();
-        while( !p->is_leaf() )
+        if( limits::top_down && _subtrees[0]->key_count() <= limits::key_lower && fix_child(0) )
         {
-            p = p->sub().front();
+            return pop_min_key(m);
         }
 
-        btree_helper::swap(p->key().front(), m);
-        p->erase_key_at(0);
-        p->rebalance();
-    }
-    
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::pop_max_key(value_type& m)
-    {
-        shptr p = thisptr();
-        while( !p->is_leaf() )
+        _subtrees[0]->pop_min_key(m);
+
+        if( !limits::top_down && _subtrees[0]->key_count() < limits::key_lower )
         {
-            p = p->sub().back();
+            fix_child(0);
         }
-
-        btree_helper::swap(p->key().back(), m);
-        p->key().pop_back();
-        p->rebalance();
+        update_aggregate();
     }
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::merge(size_t n)
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    void btree_node<K, V, Order, Aggregate, Encoding>::merge(size_t n)
     {
         shptr lsub = sub()[n];
         shptr rsub = sub()[n+1];
-    
-        lsub->key().push_back(key()[n]);
+
+        value_type s;
+        btree_helper::take(_keyvalues, n, s);
+        btree_helper::put(lsub->key(), lsub->key_count(), s);
         btree_helper::cut_paste_using_swap(
             rsub->key(), rsub->first_key(), rsub->last_key(),
             lsub->key(), lsub->last_key());
-    
-        size_t roffset = lsub->sub().size();
+
         btree_helper::cut_paste_using_swap(
             rsub->sub(), rsub->first_child(), rsub->last_child(),
             lsub->sub(), lsub->last_child());
-        lsub->update_subtree(roffset);
-    
-        erase_key_at(n);
-        erase_child_at(n+1);
-    }
+        lsub->update_aggregate();
 
-    template<typename K, typename V, size_t Order>
-    void btree_node<K, V, Order>::rebalance()
-    {
-        if( key_count() >= limits::key_lower || is_root() )
-        {
-            return;
-        }
-
-        // Try to balance current node by rotation
-        if( rotate_left() || rotate_right() )
-        {
-            return;
-        }
-
-        // If current node has a right sibling than merge current node with right
-        // sibling. Otherwise merge current node with left sibling.
-        // A non-root node has at least a sibling.
-        shptr parent = get_parent();
-        parent->merge(_selfpos < parent->key_count() ? _selfpos : _selfpos-1);
-        
-        // The parent loses a key, thus maybe deficient
-        if( parent->is_root() && !parent->key_count() )
-        {
-            shptr self = thisptr();
-            parent->sub().clear();
-            parent->swap(*self);
-            parent->_selfpos = -1;
-            parent->_parent.reset();
-            return;
-        }
-
-        parent->rebalance();
+        erase_child_at(n+1);
     }
 
 }
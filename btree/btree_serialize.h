@@ -0,0 +1,355 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+
+#include "btree.h"
+
+namespace btree_helper
+{
+    // Binary encoding of keys and values for btree::save and btree::load.
+    // Trivially copyable types are stored as their bytes in host byte order,
+    // other types need a specialization.
+    template<typename T, bool Trivial = std::is_trivially_copyable<T>::value>
+    class codec
+    {
+        static_assert(Trivial, "btree_helper::codec is not specialized for this type");
+
+    public:
+        enum { min_bytes = sizeof(T) }; // fewest bytes of an encoded value
+
+        static void write(std::vector<char>& out, const T& v)
+        {
+            size_t n = out.size();
+            out.resize(n + sizeof(T));
+            std::memcpy(&out[n], &v, sizeof(T));
+        }
+
+        static bool read(const char*& p, const char* end, T& v)
+        {
+            if( size_t(end - p) < sizeof(T) )
+            {
+                return false;
+            }
+            std::memcpy(&v, p, sizeof(T));
+            p += sizeof(T);
+            return true;
+        }
+    };
+
+    // strings are stored as their length followed by their characters
+    template<typename C, typename Traits, typename Alloc>
+    class codec<std::basic_string<C, Traits, Alloc>, false>
+    {
+    public:
+        typedef std::basic_string<C, Traits, Alloc> string_type;
+
+        enum { min_bytes = sizeof(unsigned long long) };
+
+        static void write(std::vector<char>& out, const string_type& s)
+        {
+            codec<unsigned long long>::write(out, s.size());
+            size_t n = out.size();
+            out.resize(n + s.size() * sizeof(C));
+            if( !s.empty() )
+            {
+                std::memcpy(&out[n], s.data(), s.size() * sizeof(C));
+            }
+        }
+
+        static bool read(const char*& p, const char* end, string_type& s)
+        {
+            unsigned long long size;
+            if( !codec<unsigned long long>::read(p, end, size) || size_t(end - p) / sizeof(C) < size )
+            {
+                return false;
+            }
+            s.resize(size_t(size));
+            if( size )
+            {
+                std::memcpy(&s[0], p, size_t(size) * sizeof(C));
+            }
+            p += size_t(size) * sizeof(C);
+            return true;
+        }
+    };
+
+    // Checksum of a stream of blocks, 8 bytes are mixed in at a time. Bytes
+    // of the last word of a block are padded with zeros.
+    class checksum
+    {
+    public:
+        checksum(): _h(0x9e3779b97f4a7c15ULL) {}
+
+        void update(const char* p, size_t n)
+        {
+            for(; n >= 8; p += 8, n -= 8)
+            {
+                unsigned long long w;
+                std::memcpy(&w, p, 8);
+                mix(w);
+            }
+
+            unsigned long long w = 0;
+            std::memcpy(&w, p, n);
+            mix(w ^ n);
+        }
+
+        unsigned long long value() const { return _h; }
+
+    private:
+        void mix(unsigned long long w)
+        {
+            _h ^= w;
+            _h = (_h << 29 | _h >> 35) * 0xbf58476d1ce4e5b9ULL;
+        }
+
+        unsigned long long _h;
+    };
+
+    // Layout of a saved tree, all integers in host byte order:
+    //  header:  magic, version, fixed bytes per key and per value (0 if the
+    //           length varies), number of pairs
+    //  blocks:  number of bytes followed by the encoded pairs, every block
+    //           but the last holds at least block_bytes
+    //  trailer: checksum of the header and the blocks
+    class stream_format
+    {
+    public:
+        enum
+        {
+            magic       = 0x45525442, // "BTRE"
+            version     = 2,
+            block_bytes = 1 << 16,
+        };
+
+        class header
+        {
+        public:
+            unsigned int       magic;
+            unsigned int       version;
+            unsigned int       key_bytes;
+            unsigned int       value_bytes;
+            unsigned long long count;
+        };
+
+        template<typename T>
+        static unsigned int fixed_bytes() { return std::is_trivially_copyable<T>::value ? sizeof(T) : 0; }
+
+        template<typename T>
+        static void put(std::ostream& os, const T& v) { os.write(reinterpret_cast<const char*>(&v), sizeof(T)); }
+
+        template<typename T>
+        static bool get(std::istream& is, T& v) { return !!is.read(reinterpret_cast<char*>(&v), sizeof(T)); }
+
+        template<typename T>
+        static void put(std::ostream& os, const T& v, checksum& sum)
+        {
+            put(os, v);
+            sum.update(reinterpret_cast<const char*>(&v), sizeof(T));
+        }
+
+        // number of bytes left in is, all ones if is can't tell
+        static unsigned long long remaining(std::istream& is)
+        {
+            std::istream::pos_type here = is.tellg();
+            if( here == std::istream::pos_type(-1) )
+            {
+                return ~0ULL;
+            }
+
+            is.seekg(0, std::ios::end);
+            std::istream::pos_type end = is.tellg();
+            is.seekg(here);
+            return end == std::istream::pos_type(-1) ? ~0ULL : static_cast<unsigned long long>(end - here);
+        }
+
+        // write out a block and clear it
+        static void put_block(std::ostream& os, std::vector<char>& block, checksum& sum)
+        {
+            unsigned int bytes = static_cast<unsigned int>(block.size());
+            put(os, bytes);
+            os.write(&block[0], bytes);
+            sum.update(&block[0], bytes);
+            block.clear();
+        }
+    };
+
+    // Decodes the blocks of a saved tree one by one. Feeds btree::build
+    // through an input iterator, checking that keys ascend strictly. The
+    // build stops as soon as anything is broken.
+    template<typename K, typename V>
+    class block_reader
+    {
+    public:
+        typedef std::pair<K, V> value_type;
+
+        class iterator
+        {
+        public:
+            explicit iterator(block_reader* r): _r(r), _loaded(false) {}
+
+            // a pair is decoded when it is dereferenced
+            const value_type& operator* ()
+            {
+                if( !_loaded )
+                {
+                    _r->next();
+                    _loaded = true;
+                }
+                return _r->_val;
+            }
+
+            iterator& operator++() { **this; _loaded = false; return *this; }
+
+            bool failed() const { return _r->_failed; }
+            friend bool input_failed(const iterator& it) { return it.failed(); }
+
+        private:
+            block_reader* _r;
+            bool          _loaded;
+        };
+
+        // the header is read already, it is part of the checksum
+        block_reader(std::istream& is, const stream_format::header& h): _is(is), _pos(nullptr), _end(nullptr), _first(true), _failed(false)
+        {
+            _sum.update(reinterpret_cast<const char*>(&h), sizeof(h));
+        }
+
+        // reads the trailer, returns false if anything read so far is broken
+        bool finish()
+        {
+            unsigned long long expected;
+            return !_failed && _pos == _end && stream_format::get(_is, expected) && expected == _sum.value();
+        }
+
+    private:
+        void next()
+        {
+            if( _failed )
+            {
+                return;
+            }
+
+            if( _pos == _end && !fill() )
+            {
+                _failed = true;
+                return;
+            }
+
+            K previous = _val.first;
+            if( !codec<K>::read(_pos, _end, _val.first) || !codec<V>::read(_pos, _end, _val.second)
+                || (!_first && !(previous < _val.first)) )
+            {
+                _failed = true;
+            }
+            _first = false;
+        }
+
+        bool fill()
+        {
+            unsigned int bytes;
+            if( !stream_format::get(_is, bytes) || !bytes )
+            {
+                return false;
+            }
+
+            _block.resize(bytes);
+            if( !_is.read(&_block[0], bytes) )
+            {
+                return false;
+            }
+
+            _sum.update(&_block[0], bytes);
+            _pos = &_block[0];
+            _end = _pos + bytes;
+            return true;
+        }
+
+        std::istream&     _is;
+        std::vector<char> _block;
+        const char*       _pos;
+        const char*       _end;
+        value_type        _val;
+        checksum          _sum;
+        bool              _first;
+        bool              _failed;
+    };
+}
+
+namespace algo
+{
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    bool btree<K, V, Order, Aggregate, Encoding>::save(std::ostream& os)
+    {
+        using btree_helper::stream_format;
+
+        stream_format::header h;
+        h.magic       = stream_format::magic;
+        h.version     = stream_format::version;
+        h.key_bytes   = stream_format::fixed_bytes<K>();
+        h.value_bytes = stream_format::fixed_bytes<V>();
+        h.count       = _size;
+        btree_helper::checksum sum;
+        stream_format::put(os, h, sum);
+
+        std::vector<char> block;
+        block.reserve(stream_format::block_bytes + 2 * sizeof(value_type));
+        for(iterator it = begin(); it != end(); ++it)
+        {
+            btree_helper::codec<K>::write(block, it->first);
+            btree_helper::codec<V>::write(block, it->second);
+            if( block.size() >= stream_format::block_bytes )
+            {
+                stream_format::put_block(os, block, sum);
+            }
+        }
+        if( !block.empty() )
+        {
+            stream_format::put_block(os, block, sum);
+        }
+
+        stream_format::put(os, sum.value());
+        return !!os;
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    bool btree<K, V, Order, Aggregate, Encoding>::load(std::istream& is)
+    {
+        using btree_helper::stream_format;
+
+        stream_format::header h;
+        if( !stream_format::get(is, h) || h.magic != stream_format::magic || h.version != stream_format::version
+            || h.key_bytes != stream_format::fixed_bytes<K>() || h.value_bytes != stream_format::fixed_bytes<V>() )
+        {
+            return false;
+        }
+
+        // The header is only checked against the checksum at the end, so
+        // the number of pairs can't take more bytes than the stream has left
+        // when the stream tells. Otherwise a short stream stops the build.
+        unsigned long long pair_bytes = btree_helper::codec<K>::min_bytes + btree_helper::codec<V>::min_bytes;
+        if( h.count > size_t(-1) || h.count > stream_format::remaining(is) / pair_bytes )
+        {
+            return false;
+        }
+
+        // build aside, the tree is kept as is if the stream is broken
+        btree_helper::block_reader<K, V> reader(is, h);
+        my_type loaded;
+        loaded.assign_sorted(typename btree_helper::block_reader<K, V>::iterator(&reader), size_t(h.count));
+        if( !reader.finish() )
+        {
+            return false;
+        }
+
+        _root.swap(loaded._root);
+        _rightmost.reset();
+        _size = loaded._size;
+        ++_epoch;
+        return true;
+    }
+}
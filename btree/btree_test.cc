@@ -1,15 +1,22 @@
 #include "btree_test.h"
+#include "betree.h"
+#include "sharded_btree.h"
+#include "btree_multimap.h"
+#include "art_map.h"
+#include "interval_btree.h"
 
 #include <iostream>
 #include <sstream>
 #include <random>
 #include <map>
+#include <cmath>
 #include <Windows.h>
 #include <DbgHelp.h>
 
 typedef algo::btree<int,int,3> tree_t;
 
-bool assert_tree(tree_t& tr, const std::string& expected)
+template<typename Tree>
+bool assert_tree(Tree& tr, const std::string& expected)
 {
     std::stringstream ss;
     for(auto it = tr.begin(); it != tr.end(); ++it)
@@ -19,6 +26,32 @@ bool assert_tree(tree_t& tr, const std::string& expected)
     return ss.str() == expected;
 }
 
+template<typename Tree>
+bool assert_betree(Tree& tr, const std::string& expected)
+{
+    std::stringstream ss;
+    tr.for_each([&ss](const typename Tree::value_type& v){ ss << v.first << ':' << v.second << ','; });
+    return ss.str() == expected;
+}
+
+// saved tree with a forged number of pairs in the header
+std::string with_count(std::string saved, unsigned long long count)
+{
+    std::memcpy(&saved[16], &count, sizeof(count));
+    return saved;
+}
+
+// stream which can't tell how many bytes are left
+class unseekable_buf : public std::stringbuf
+{
+public:
+    explicit unseekable_buf(const std::string& s): std::stringbuf(s) {}
+
+protected:
+    pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) { return pos_type(-1); }
+    pos_type seekpos(pos_type, std::ios_base::openmode) { return pos_type(-1); }
+};
+
 static size_t gErrors = 0;
 #define TESTCASE_EVAL(expr)\
 { bool r = expr; if(!r) ++gErrors; std::cout << "Case " << #expr << ": "  << (r ? "PASSED" : "FAILED") << "\n"; }
@@ -65,6 +98,422 @@ void run_test_cases()
     TESTCASE_EVAL(tr.find(10)->first == 10);
     TESTCASE_EVAL(tr.find(100) == tr.end());
     TESTCASE_EVAL(tr.find(1) == tr.end());
+
+    // hinted insert
+    tr.insert(tr.find(5), std::make_pair(4, 0));
+    tr.insert(tr.find(20), std::make_pair(15, 0));
+    tr.insert(tr.find(2), std::make_pair(1, 0));
+    tr.insert(tr.end(), std::make_pair(9, 0));
+    TESTCASE_EVAL(assert_tree(tr, "1,2,3,4,5,6,7,8,9,10,11,15,20,21,"));
+
+    // front cache of find, kept valid through splits and merges
+    tree_t cached;
+    cached.enable_cache(16);
+    for(int i = 0; i < 100; ++i)
+    {
+        cached.insert(std::make_pair(i * 7 % 100, i));
+    }
+    TESTCASE_EVAL(cached.find(50)->first == 50 && cached.cache_misses() == 1);
+    TESTCASE_EVAL(cached.find(50)->first == 50 && cached.cache_hits() == 1);
+    for(int i = 100; i < 200; ++i)
+    {
+        cached.insert(std::make_pair(i, i));
+    }
+    TESTCASE_EVAL(cached.find(50)->first == 50 && cached.cache_hits() == 2);
+    for(int i = 0; i < 50; ++i)
+    {
+        cached.erase(i);
+    }
+    TESTCASE_EVAL(cached.find(50)->first == 50 && cached.cache_misses() == 2);
+    cached.erase(50);
+    TESTCASE_EVAL(cached.find(50) == cached.end());
+
+    // iterating on from a cached position
+    int visited = 0, last = 50;
+    for(tree_t::iterator it = cached.find(51); it != cached.end() && it->first == last + 1; ++it, ++visited)
+    {
+        last = it->first;
+    }
+    TESTCASE_EVAL(cached.cache_hits() == 2 && visited == 149 && last == 199);
+    visited = 0;
+    for(tree_t::iterator it = cached.find(51); it != cached.end(); ++it)
+    {
+        ++visited;
+    }
+    TESTCASE_EVAL(cached.cache_hits() == 3 && visited == 149);
+
+    // iterating backwards, from the end and from a cached position
+    std::stringstream rs;
+    for(tree_t::reverse_iterator it = tr.rbegin(); it != tr.rend(); ++it)
+    {
+        rs << it->first << ',';
+    }
+    TESTCASE_EVAL(rs.str() == "21,20,15,11,10,9,8,7,6,5,4,3,2,1,");
+    const tree_t& ctr = tr;
+    tree_t::const_iterator cit = ctr.end();
+    TESTCASE_EVAL((--cit)->first == 21 && (--ctr.begin()) == ctr.end() && (++ctr.end())->first == 1);
+    TESTCASE_EVAL(ctr.rbegin()->first == 21 && tree_t().rbegin() == tree_t().rend());
+    cached.find(120);
+    visited = 0;
+    for(tree_t::iterator it = cached.find(120); it != cached.end(); --it)
+    {
+        ++visited;
+    }
+    TESTCASE_EVAL(cached.cache_hits() == 4 && visited == 70);
+
+    // a cache hit equals the same key found from the root, iterators with
+    // paths of different lengths are equal on the same key only
+    tree_t::iterator hit = cached.find(120), bound = cached.lower_bound(120);
+    TESTCASE_EVAL(cached.cache_hits() == 5 && hit == bound && bound == hit);
+    size_t mismatches = 0;
+    for(int i = 51; i < 200; ++i)
+    {
+        cached.find(i);
+        size_t hits = cached.cache_hits();
+        tree_t::iterator a = cached.find(i), b = cached.lower_bound(i);
+        mismatches += cached.cache_hits() != hits + 1;
+        for(int j = 51; j < 200; ++j)
+        {
+            tree_t::iterator c = cached.lower_bound(j);
+            mismatches += (a == c) != (i == j) || (c == a) != (i == j) || (b == c) != (i == j) || (c == b) != (i == j);
+        }
+    }
+    TESTCASE_EVAL(mismatches == 0);
+
+    // keys without a hash, found without the cache
+    algo::btree<std::pair<int,int>, int, 3> unhashed;
+    unhashed.enable_cache(16);
+    for(int i = 0; i < 50; ++i)
+    {
+        unhashed.insert(std::make_pair(std::make_pair(i % 5, i), i));
+    }
+    unhashed.find(std::make_pair(3, 8));
+    TESTCASE_EVAL(unhashed.find(std::make_pair(3, 8))->second == 8 && unhashed.find(std::make_pair(3, 9)) == unhashed.end() &&
+                  unhashed.cache_hits() == 0 && unhashed.cache_misses() == 0);
+
+    // right edge appending
+    tree_t seq;
+    std::stringstream expected;
+    for(int i = 0; i < 100; ++i)
+    {
+        seq.insert(std::make_pair(i, i));
+        expected << i << ',';
+    }
+    TESTCASE_EVAL(assert_tree(seq, expected.str()));
+    seq.erase(99);
+    seq.insert(std::make_pair(100, 0));
+    seq.insert(std::make_pair(99, 0));
+    expected << 100 << ',';
+    TESTCASE_EVAL(assert_tree(seq, expected.str()));
+
+    // top-down updates, nodes of order 4 are split and fixed on the way down
+    algo::btree<int,int,4> td;
+    std::stringstream td_expected;
+    for(int i = 0; i < 60; ++i)
+    {
+        td.insert(std::make_pair(i * 7 % 60, i));
+    }
+    for(int i = 0; i < 60; ++i)
+    {
+        if( i % 3 )
+        {
+            td_expected << i << ',';
+        }
+        else
+        {
+            td.erase(i);
+        }
+    }
+    TESTCASE_EVAL(assert_tree(td, td_expected.str()));
+    for(int i = 1; i < 60; i += 3)
+    {
+        td.erase(i);
+    }
+    td.erase(59);
+    TESTCASE_EVAL(assert_tree(td, "2,5,8,11,14,17,20,23,26,29,32,35,38,41,44,47,50,53,56,"));
+
+    // buffered writes of B-epsilon tree
+    algo::betree<int, int, 3, 4> be;
+    for(int i = 0; i < 20; ++i)
+    {
+        be.insert(std::make_pair(i, i));
+    }
+    for(int i = 0; i < 20; i += 2)
+    {
+        be.erase(i);
+    }
+    be.upsert(3, 100);
+    be.upsert(3, 1);
+    be.upsert(4, 7);
+    int v = 0;
+    TESTCASE_EVAL(be.find(3, v) && v == 104);
+    TESTCASE_EVAL(be.find(4, v) && v == 7);
+    TESTCASE_EVAL(!be.find(6, v));
+    TESTCASE_EVAL(assert_betree(be, "1:1,3:104,4:7,5:5,7:7,9:9,11:11,13:13,15:15,17:17,19:19,"));
+
+    std::stringstream ss;
+    be.for_each(4, 11, [&ss](const std::pair<int,int>& kv){ ss << kv.first << ','; });
+    TESTCASE_EVAL(ss.str() == "4,5,7,9,");
+    size_t inverted = 0;
+    be.for_each(11, 4, [&inverted](const std::pair<int,int>&){ ++inverted; });
+    be.for_each(5, 5, [&inverted](const std::pair<int,int>&){ ++inverted; });
+    TESTCASE_EVAL(inverted == 0);
+
+    // freeze and thaw
+    algo::frozen_btree<int, int, 3> frozen = tr.freeze();
+    TESTCASE_EVAL(frozen.size() == 14);
+    TESTCASE_EVAL(frozen.find(15)->first == 15);
+    TESTCASE_EVAL(frozen.find(12) == frozen.end());
+    TESTCASE_EVAL(frozen.lower_bound(12)->first == 15);
+    TESTCASE_EVAL(frozen.upper_bound(15)->first == 20);
+    TESTCASE_EVAL(frozen.lower_bound(22) == frozen.end());
+
+    tree_t thawed = frozen.thaw();
+    TESTCASE_EVAL(assert_tree(thawed, "1,2,3,4,5,6,7,8,9,10,11,15,20,21,"));
+    thawed.erase(15);
+    thawed.insert(std::make_pair(0, 0));
+    TESTCASE_EVAL(assert_tree(thawed, "0,1,2,3,4,5,6,7,8,9,10,11,20,21,"));
+
+    // frame-of-reference packed leaves
+    algo::packed_btree<int, int, 3> packed = tr.pack();
+    std::stringstream pks;
+    for(auto it = packed.begin(); it != packed.end(); ++it)
+    {
+        pks << it->first << ',';
+    }
+    TESTCASE_EVAL(pks.str() == "1,2,3,4,5,6,7,8,9,10,11,15,20,21,");
+    TESTCASE_EVAL(packed.find(15)->first == 15);
+    TESTCASE_EVAL(packed.find(12) == packed.end());
+    TESTCASE_EVAL(packed.lower_bound(12)->first == 15);
+    TESTCASE_EVAL(packed.upper_bound(15)->first == 20);
+    TESTCASE_EVAL(packed.upper_bound(21) == packed.end());
+    TESTCASE_EVAL(packed.lower_bound(-5) == packed.begin());
+    tree_t unpacked = packed.thaw();
+    TESTCASE_EVAL(assert_tree(unpacked, "1,2,3,4,5,6,7,8,9,10,11,15,20,21,"));
+
+    // delta encoded keys, a far key and one before the first re-encode nodes
+    typedef btree_helper::no_aggregate<unsigned> no_sum;
+    algo::btree<unsigned long long, unsigned, 4, no_sum, btree_helper::delta_encoding> delta;
+    for(unsigned i = 1; i <= 20; ++i)
+    {
+        delta.insert(std::make_pair(i * 3ULL, i));
+    }
+    delta.insert(std::make_pair(1ULL << 40, 40u));
+    delta.insert(std::make_pair(0ULL, 0u));
+    delta.erase(30);
+    delta.erase(3);
+    delta.find(6)->second = 100;
+    TESTCASE_EVAL(assert_tree(delta, "0,6,9,12,15,18,21,24,27,33,36,39,42,45,48,51,54,57,60,1099511627776,"));
+    TESTCASE_EVAL(delta.size() == 20 && delta.find(6)->second == 100 && delta.find(7) == delta.end());
+    TESTCASE_EVAL(delta.lower_bound(31)->first == 33 && delta.floor(31)->first == 27);
+    TESTCASE_EVAL((--delta.end())->first == 1ULL << 40 && delta.rbegin()->second == 40);
+
+    // delta encoded pairs pasted before the last ones of a node
+    btree_helper::delta_keyvalues<unsigned long long, unsigned> cut, paste;
+    for(unsigned i = 0; i < 4; ++i)
+    {
+        cut.push_back(std::make_pair(10ULL + i, i));
+        paste.push_back(std::make_pair(i < 2 ? i : 1000ULL + i, i));
+    }
+    btree_helper::cut_paste_using_swap(cut, cut.begin() + 1, cut.begin() + 3, paste, paste.begin() + 2);
+    std::stringstream pasted;
+    for(size_t i = 0; i < paste.size(); ++i)
+    {
+        pasted << paste.key(i) << ':' << paste[i].second << ',';
+    }
+    TESTCASE_EVAL(pasted.str() == "0:0,1:1,11:1,12:2,1002:2,1003:3," && cut.size() == 2 && cut.key(1) == 13);
+
+    // saving and reloading
+    std::stringstream saved;
+    TESTCASE_EVAL(tr.save(saved));
+    tree_t reloaded;
+    TESTCASE_EVAL(reloaded.load(saved) && reloaded.size() == 14);
+    TESTCASE_EVAL(assert_tree(reloaded, "1,2,3,4,5,6,7,8,9,10,11,15,20,21,"));
+    std::string corrupted = saved.str();
+    corrupted[corrupted.size() / 2] ^= 1;
+    std::stringstream broken(corrupted);
+    TESTCASE_EVAL(!reloaded.load(broken) && reloaded.size() == 14);
+    std::stringstream truncated(saved.str().substr(0, saved.str().size() - 1));
+    TESTCASE_EVAL(!reloaded.load(truncated));
+    std::stringstream forged(with_count(saved.str(), 1ULL << 44));
+    TESTCASE_EVAL(!reloaded.load(forged) && reloaded.size() == 14);
+    unseekable_buf endless(with_count(saved.str(), ~0ULL));
+    std::istream endless_stream(&endless);
+    TESTCASE_EVAL(!reloaded.load(endless_stream) && reloaded.size() == 14);
+    unseekable_buf unbounded(saved.str());
+    std::istream unbounded_stream(&unbounded);
+    TESTCASE_EVAL(reloaded.load(unbounded_stream) && reloaded.size() == 14);
+    algo::btree<std::string, std::string, 4> names;
+    names.insert(std::make_pair(std::string("b"), std::string("")));
+    names.insert(std::make_pair(std::string("a"), std::string("alpha")));
+    std::stringstream saved_names;
+    TESTCASE_EVAL(names.save(saved_names));
+    algo::btree<std::string, std::string, 4> names_reloaded;
+    TESTCASE_EVAL(names_reloaded.load(saved_names) && names_reloaded.find("a")->second == "alpha");
+    std::stringstream mismatched(saved_names.str());
+    TESTCASE_EVAL(!reloaded.load(mismatched));
+
+    // sharded map, keys spread over the shards as the map grows
+    algo::sharded_btree<int, int, 3> sharded(4);
+    for(int i = 0; i < 20000; ++i)
+    {
+        sharded.insert(std::make_pair(i * 7 % 20000, i));
+    }
+    for(int i = 0; i < 20000; i += 2)
+    {
+        sharded.erase(i);
+    }
+    int sv = 0;
+    TESTCASE_EVAL(sharded.size() == 10000);
+    TESTCASE_EVAL(sharded.find(7, sv) && sv == 1);
+    TESTCASE_EVAL(!sharded.find(8, sv));
+    TESTCASE_EVAL(sharded.shard_size(0) && sharded.shard_size(3));
+    std::stringstream shs;
+    sharded.for_each(19990, 30000, [&shs](const std::pair<int,int>& kv){ shs << kv.first << ','; });
+    TESTCASE_EVAL(shs.str() == "19991,19993,19995,19997,19999,");
+    int previous = -1;
+    bool ordered = true;
+    sharded.for_each([&previous, &ordered](const std::pair<int,int>& kv){ ordered = ordered && previous < kv.first; previous = kv.first; });
+    TESTCASE_EVAL(ordered && previous == 19999);
+    sharded.for_each(10000, 20000, [&sharded](const std::pair<int,int>& kv){ sharded.erase(kv.first); });
+    TESTCASE_EVAL(sharded.size() == 5000 && !sharded.find(10001, sv) && sharded.find(9999, sv));
+
+    // concurrent inserts, keys move between shards meanwhile
+    algo::sharded_btree<int, int, 4> concurrent(8);
+    std::vector<std::thread> writers;
+    for(int t = 0; t < 4; ++t)
+    {
+        writers.push_back(std::thread([&concurrent, t](){
+            for(int i = 0; i < 20000; ++i)
+            {
+                concurrent.insert(std::make_pair((i * 4 + t) * 7 % 80000, i));
+            }
+        }));
+    }
+    for(size_t t = 0; t < writers.size(); ++t)
+    {
+        writers[t].join();
+    }
+    size_t pairs_seen = 0;
+    previous = -1;
+    ordered = true;
+    concurrent.for_each([&previous, &ordered, &pairs_seen](const std::pair<int,int>& kv){ ordered = ordered && previous < kv.first; previous = kv.first; ++pairs_seen; });
+    TESTCASE_EVAL(concurrent.size() == 80000 && pairs_seen == 80000 && ordered);
+    TESTCASE_EVAL(concurrent.shard_size(0) && concurrent.shard_size(0) < 80000);
+
+    // duplicate keys, kept in insertion order
+    algo::btree_multimap<int, int, 3> multi;
+    for(int i = 0; i < 60; ++i)
+    {
+        multi.insert(std::make_pair(i % 4, i));
+    }
+    TESTCASE_EVAL(multi.size() == 60 && multi.count(2) == 15 && multi.count(7) == 0);
+    TESTCASE_EVAL(multi.erase_one(2) && multi.find(2)->second == 6);
+    TESTCASE_EVAL(multi.erase(3) == 15 && multi.count(3) == 0 && !multi.erase_one(3));
+    multi.find(1)->second = -1;
+    std::stringstream mms;
+    std::pair<algo::btree_multimap<int, int, 3>::iterator, algo::btree_multimap<int, int, 3>::iterator> range = multi.equal_range(1);
+    for(int n = 0; range.first != range.second && n < 4; ++range.first, ++n)
+    {
+        mms << range.first->second << ',';
+    }
+    TESTCASE_EVAL(mms.str() == "-1,5,9,13,");
+    TESTCASE_EVAL(multi.upper_bound(2) == multi.end() && multi.size() == 44);
+
+    // equal ranges crossing leaves, after random inserts and erases
+    algo::btree_multimap<int, int, 3> shuffled;
+    std::multimap<int, int> shuffled_ref;
+    std::mt19937 mgen(11);
+    for(int i = 0; i < 2000; ++i)
+    {
+        int k = mgen() % 40;
+        if( mgen() % 3 )
+        {
+            shuffled.insert(std::make_pair(k, i));
+            shuffled_ref.insert(std::make_pair(k, i));
+        }
+        else if( shuffled.erase_one(k) )
+        {
+            shuffled_ref.erase(shuffled_ref.find(k));
+        }
+    }
+    size_t range_errors = 0;
+    for(int k = -1; k <= 40; ++k)
+    {
+        std::pair<algo::btree_multimap<int, int, 3>::iterator, algo::btree_multimap<int, int, 3>::iterator> r = shuffled.equal_range(k);
+        size_t n = std::distance(r.first, r.second);
+        range_errors += n != shuffled.count(k) || n != shuffled_ref.count(k);
+    }
+    TESTCASE_EVAL(range_errors == 0 && shuffled.size() == shuffled_ref.size());
+
+    // range aggregates
+    algo::btree<int, int, 3, btree_helper::sum_aggregate<int> > sums;
+    algo::btree<int, int, 3, btree_helper::max_aggregate<int> > maxs;
+    for(int i = 1; i <= 20; ++i)
+    {
+        sums.insert(std::make_pair(i, i));
+        maxs.insert(std::make_pair(i, i % 7));
+    }
+    TESTCASE_EVAL(sums.aggregate() == 210);
+    TESTCASE_EVAL(sums.aggregate(5, 11) == 5 + 6 + 7 + 8 + 9 + 10);
+    TESTCASE_EVAL(maxs.aggregate(7, 10) == 2);
+    sums.insert(std::make_pair(6, 100));
+    sums.erase(8);
+    TESTCASE_EVAL(sums.aggregate(5, 11) == 5 + 100 + 7 + 9 + 10);
+    maxs.erase(13);
+    TESTCASE_EVAL(maxs.aggregate(10, 20) == 5);
+    TESTCASE_EVAL(maxs.aggregate(30, 40) == btree_helper::max_aggregate<int>::identity());
+
+    // disjoint ranges, cut by overlapping inserts and joined when adjacent
+    algo::interval_btree<int, char, 3> ranges;
+    ranges.insert(0, 10, 'a');
+    ranges.insert(20, 30, 'b');
+    ranges.insert(5, 25, 'c');
+    ranges.insert(25, 28, 'c');
+    ranges.insert(10, 20, 'a');
+    char rv = 0;
+    TESTCASE_EVAL(ranges.size() == 5 && ranges.find(12, rv) && rv == 'a' && !ranges.find(30, rv));
+    TESTCASE_EVAL(ranges.find(27, rv) && rv == 'c' && ranges.find(29, rv) && rv == 'b');
+    ranges.erase(3, 6);
+    std::stringstream rgs;
+    ranges.for_each(4, 21, [&rgs](int start, int end, char v){ rgs << start << '-' << end << v << ','; });
+    TESTCASE_EVAL(rgs.str() == "6-10c,10-20a,20-28c,");
+
+    // adaptive radix tree, negative keys and node growth and shrinking
+    algo::art_map<int, int> art;
+    for(int i = 0; i < 300; ++i)
+    {
+        art.insert(std::make_pair(i * 7 % 300 - 100, i));
+    }
+    for(int i = -100; i < 200; i += 3)
+    {
+        art.erase(i);
+    }
+    TESTCASE_EVAL(art.size() == 200 && art.find(-99)->second == 43 && art.find(-100) == art.end());
+    std::stringstream arts;
+    for(algo::art_map<int, int>::iterator it = art.lower_bound(185); it != art.end(); ++it)
+    {
+        arts << it->first << ',';
+    }
+    TESTCASE_EVAL(arts.str() == "186,187,189,190,192,193,195,196,198,199,");
+    algo::art_map<std::string, int> words;
+    words.insert(std::make_pair(std::string("abc"), 1));
+    words.insert(std::make_pair(std::string("ab"), 2));
+    words.insert(std::make_pair(std::string("abd"), 3));
+    TESTCASE_EVAL(words.begin()->first == "ab" && words.lower_bound("abca")->first == "abd");
+
+    // parallel partitioned iteration
+    std::vector<std::vector<int> > parts(3);
+    sums.parallel_for_each(3, 18, [&parts](size_t n, std::pair<int,int>& v){ parts[n].push_back(v.first); }, 3);
+    std::stringstream pss;
+    for(size_t n = 0; n < parts.size(); ++n)
+    {
+        for(size_t i = 0; i < parts[n].size(); ++i)
+        {
+            pss << parts[n][i] << ',';
+        }
+    }
+    TESTCASE_EVAL(pss.str() == "3,4,5,6,7,9,10,11,12,13,14,15,16,17,");
 }
 
 #define PERFORMANCE_EVAL(expr)\
@@ -83,6 +532,103 @@ void performance_test_insert(Map& m, const Vec& v, size_t n)
     }
 }
 
+template<typename Seq, typename Vec>
+void performance_test_push_back(Seq& s, const Vec& v, size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+    {
+        s.push_back(v[i]);
+    }
+}
+
+// results of performance tests are written here to keep them from being optimized out
+static volatile long long gSink = 0;
+
+template<typename Map, typename Vec>
+void performance_test_find(Map& m, const Vec& v, size_t n)
+{
+    long long found = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        found += m.find(v[i].first) != m.end();
+    }
+    gSink = found;
+}
+
+template<typename Map>
+void performance_test_parallel_scan(Map& m, size_t threads)
+{
+    // partial sums are padded to avoid false sharing between threads
+    std::vector<long long> sums(threads * 16, 0);
+    m.parallel_for_each([&sums](size_t n, std::pair<int,int>& v){ sums[n * 16] += v.first % 7; }, threads);
+
+    long long total = 0;
+    for(size_t n = 0; n < threads; ++n)
+    {
+        total += sums[n * 16];
+    }
+    gSink = total;
+}
+
+template<typename Map, typename Vec>
+void performance_test_concurrent_insert(Map& m, const Vec& v, size_t n, size_t threads)
+{
+    // each thread inserts a contiguous slice of v
+    std::vector<std::thread> pool;
+    for(size_t t = 0; t < threads; ++t)
+    {
+        pool.push_back(std::thread([&m, &v, n, threads, t](){
+            for(size_t i = n * t / threads; i < n * (t + 1) / threads; ++i)
+            {
+                m.insert(v[i]);
+            }
+        }));
+    }
+    for(size_t t = 0; t < threads; ++t)
+    {
+        pool[t].join();
+    }
+}
+
+template<typename Map, typename Vec>
+void performance_test_contains(Map& m, const Vec& v, size_t n)
+{
+    long long found = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        typename Map::key_type k = v[i].first;
+        int value;
+        found += m.find(k, value);
+    }
+    gSink = found;
+}
+
+template<typename Iterator>
+void performance_test_scan(Iterator first, Iterator last)
+{
+    long long sum = 0;
+    for(; first != last; ++first)
+    {
+        sum += first->first;
+    }
+    gSink = sum;
+}
+
+template<typename Map, typename Vec>
+void performance_test_range_scan(Map& m, const Vec& v, size_t n, size_t len)
+{
+    long long sum = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        typename Map::iterator it = m.lower_bound(v[i].first);
+        for(size_t j = 0; j < len && it != m.end(); ++j, ++it)
+        {
+            sum += it->first;
+        }
+    }
+    gSink = sum;
+}
+
 template<typename Map, typename Vec>
 void performance_test_erase(Map& m, const Vec& v, size_t n)
 {
@@ -122,6 +668,110 @@ bool performance_test()
     std::random_shuffle(randoms.begin(), randoms.end());
     //PERFORMANCE_EVAL(performance_test_erase(std_map, randoms, N));
     PERFORMANCE_EVAL(performance_test_erase(btree_map, randoms, N));
+
+    // sequential appending compared with std::vector
+    std::sort(randoms.begin(), randoms.end());
+    std::vector<std::pair<int,int> > vec;
+    algo::btree<int, int, 128> btree_seq;
+    PERFORMANCE_EVAL(performance_test_push_back(vec, randoms, N));
+    PERFORMANCE_EVAL(performance_test_insert(btree_seq, randoms, N));
+
+    // lookups, btree vs. frozen btree
+    std::random_shuffle(randoms.begin(), randoms.end());
+    algo::frozen_btree<int, int, 128> frozen_seq = btree_seq.freeze();
+    PERFORMANCE_EVAL(performance_test_find(btree_seq, randoms, N));
+    PERFORMANCE_EVAL(performance_test_find(frozen_seq, randoms, N));
+
+    // skewed lookups, the rank of a key follows a Zipf distribution with
+    // exponent 1, btree with and without front cache
+    std::vector<std::pair<int,int> > skewed;
+    skewed.reserve(N);
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    for(size_t i = 0; i < N; ++i)
+    {
+        size_t rank = size_t(std::exp(unit(gen) * std::log(double(N)))) - 1;
+        skewed.push_back(randoms[std::min(rank, N - 1)]);
+    }
+    PERFORMANCE_EVAL(performance_test_find(btree_seq, skewed, N));
+    btree_seq.enable_cache(4096);
+    PERFORMANCE_EVAL(performance_test_find(btree_seq, skewed, N));
+    std::cout << "front cache hits : " << btree_seq.cache_hits() << ", misses : " << btree_seq.cache_misses() << "\n";
+    btree_seq.enable_cache(0);
+
+    // lookups and memory, frozen btree vs. packed leaves
+    algo::packed_btree<int, int, 128> packed_seq = btree_seq.pack();
+    PERFORMANCE_EVAL(performance_test_find(packed_seq, randoms, N));
+    std::cout << "frozen_seq : " << N * sizeof(std::pair<int,int>) << " bytes of pairs, packed_seq : "
+              << packed_seq.memory() << " bytes.\n";
+
+    // random inserts and lookups, pairs vs. delta encoded keys
+    algo::btree<unsigned long long, unsigned, 128> plain_ids;
+    algo::btree<unsigned long long, unsigned, 128, btree_helper::no_aggregate<unsigned>, btree_helper::delta_encoding> delta_ids;
+    PERFORMANCE_EVAL(performance_test_insert(plain_ids, randoms, N));
+    PERFORMANCE_EVAL(performance_test_insert(delta_ids, randoms, N));
+    PERFORMANCE_EVAL(performance_test_find(plain_ids, randoms, N));
+    PERFORMANCE_EVAL(performance_test_find(delta_ids, randoms, N));
+
+    // saving and reloading compared with inserting
+    std::stringstream saved;
+    algo::btree<int, int, 128> reloaded;
+    PERFORMANCE_EVAL(btree_seq.save(saved));
+    PERFORMANCE_EVAL(reloaded.load(saved));
+
+    // full scans, ascending and descending
+    PERFORMANCE_EVAL(performance_test_scan(btree_seq.begin(), btree_seq.end()));
+    PERFORMANCE_EVAL(performance_test_scan(btree_seq.rbegin(), btree_seq.rend()));
+
+    // scan scaling with number of threads, times are comparable only up to
+    // the number of cores
+    std::cout << std::thread::hardware_concurrency() << " cores\n";
+    for(size_t threads = 1; threads <= 8; threads *= 2)
+    {
+        std::cout << threads << " threads, ";
+        PERFORMANCE_EVAL(performance_test_parallel_scan(btree_seq, threads));
+    }
+
+    // concurrent random inserts into a sharded map
+    std::random_shuffle(randoms.begin(), randoms.end());
+    for(size_t threads = 1; threads <= 8; threads *= 2)
+    {
+        algo::sharded_btree<int, int, 128> sharded(16);
+        std::cout << threads << " threads, ";
+        PERFORMANCE_EVAL(performance_test_concurrent_insert(sharded, randoms, N, threads));
+    }
+
+    // random writes, btree vs. B-epsilon tree
+    std::random_shuffle(randoms.begin(), randoms.end());
+    algo::btree<int, int, 128> btree_rand;
+    algo::betree<int, int, 16, 1024> betree_rand;
+    PERFORMANCE_EVAL(performance_test_insert(btree_rand, randoms, N));
+    PERFORMANCE_EVAL(performance_test_insert(betree_rand, randoms, N));
+    std::random_shuffle(randoms.begin(), randoms.end());
+    PERFORMANCE_EVAL(performance_test_erase(btree_rand, randoms, N));
+    PERFORMANCE_EVAL(performance_test_erase(betree_rand, randoms, N));
+
+    // point lookups in disjoint ranges of 10 keys, 16 apart
+    algo::interval_btree<int, int, 128> blocks;
+    for(int i = 0; i < int(N / 16); ++i)
+    {
+        blocks.insert(i * 16, i * 16 + 10, i);
+    }
+    PERFORMANCE_EVAL(performance_test_contains(blocks, randoms, N));
+
+    // the same workloads on btree and adaptive radix tree
+    std::random_shuffle(randoms.begin(), randoms.end());
+    algo::btree<int, int, 128> btree_index;
+    algo::art_map<int, int> art_index;
+    PERFORMANCE_EVAL(performance_test_insert(btree_index, randoms, N));
+    PERFORMANCE_EVAL(performance_test_insert(art_index, randoms, N));
+    std::random_shuffle(randoms.begin(), randoms.end());
+    PERFORMANCE_EVAL(performance_test_find(btree_index, randoms, N));
+    PERFORMANCE_EVAL(performance_test_find(art_index, randoms, N));
+    PERFORMANCE_EVAL(performance_test_range_scan(btree_index, randoms, N / 10, 100));
+    PERFORMANCE_EVAL(performance_test_range_scan(art_index, randoms, N / 10, 100));
+    PERFORMANCE_EVAL(performance_test_erase(btree_index, randoms, N));
+    PERFORMANCE_EVAL(performance_test_erase(art_index, randoms, N));
     return true;
 }
 
@@ -0,0 +1,161 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+
+#include "btree.h"
+
+namespace algo
+{
+    // Immutable b-tree for read-only phases.
+    // All key-value pairs are stored in one array. The ordered pairs are
+    // preceded by the index, whose nodes are laid out in level order from the
+    // root down, every node is full except the last one of each level. Child
+    // nodes are located by arithmetic instead of pointers: the c-th subtree of
+    // node j lives at position j * Order + c of the next level.
+    template<typename K, typename V, size_t Order>
+    class frozen_btree
+    {
+    public:
+        typedef frozen_btree<K, V, Order>  my_type;
+        typedef std::pair<K, V>            value_type;
+        typedef K                          key_type;
+        typedef const value_type*          iterator;
+        typedef const value_type*          const_iterator;
+
+        enum
+        {
+            node_keys = Order - 1, // keys per node, also pairs per leaf
+            fanout    = Order,     // subtrees per internal node
+        };
+
+        frozen_btree(): _size(0) {}
+
+        // build from count ordered, unique key-value pairs starting from first
+        template<typename InputIterator>
+        frozen_btree(InputIterator first, size_t count);
+
+        size_t size() const  { return _size; }
+        bool   empty() const { return !_size; }
+
+        const_iterator begin() const { return _slots.data() + _slots.size() - _size; }
+        const_iterator end() const   { return _slots.data() + _slots.size(); }
+
+        // Find the first pair whose key is not less than k
+        const_iterator lower_bound(const key_type& k) const { return search(k, false); }
+
+        // Find the first pair whose key is greater than k
+        const_iterator upper_bound(const key_type& k) const { return search(k, true); }
+
+        const_iterator find(const key_type& k) const
+        {
+            const_iterator it = lower_bound(k);
+            return it != end() && !(k < it->first) ? it : end();
+        }
+
+        // rebuild a mutable btree from the contents
+        btree<K, V, Order> thaw() const
+        {
+            btree<K, V, Order> tr;
+            tr.assign_sorted(begin(), _size);
+            return tr;
+        }
+
+    private:
+        const_iterator search(const key_type& k, bool upper) const;
+
+        // Index levels from the root down, in front of the ordered pairs.
+        // Only the keys of index slots are meaningful.
+        std::vector<value_type> _slots;
+        std::vector<size_t>     _offset; // first slot of each index level
+        std::vector<size_t>     _nodes;  // number of nodes of each level, leaves included
+        size_t                  _size;
+    };
+
+    template<typename K, typename V, size_t Order>
+    template<typename InputIterator>
+    frozen_btree<K, V, Order>::frozen_btree(InputIterator first, size_t count): _size(count)
+    {
+        if( !count )
+        {
+            return;
+        }
+
+        // count nodes level by level, from leaves up to the root
+        std::vector<size_t> nodes(1, (count + node_keys - 1) / node_keys);
+        while( nodes.back() > 1 )
+        {
+            nodes.push_back((nodes.back() + fanout - 1) / fanout);
+        }
+        _nodes.assign(nodes.rbegin(), nodes.rend());
+
+        size_t index_slots = 0;
+        for(size_t l = 0; l + 1 < _nodes.size(); ++l)
+        {
+            _offset.push_back(index_slots);
+            index_slots += _nodes[l] * node_keys;
+        }
+
+        _slots.reserve(index_slots + count);
+        _slots.resize(index_slots);
+        for(size_t n = 0; n < count; ++n, ++first)
+        {
+            _slots.push_back(*first);
+        }
+
+        // The separator between two subtrees is the minimum key of the right
+        // one. A subtree at d levels above the leaves covers Order^d leaves.
+        const value_type* data = &_slots[index_slots];
+        size_t span = node_keys;
+        for(size_t l = _nodes.size() - 1; l != 0; --l, span *= fanout)
+        {
+            size_t children = _nodes[l];
+            for(size_t c = 1; c < children; ++c)
+            {
+                if( c % fanout )
+                {
+                    size_t j = c / fanout;
+                    _slots[_offset[l-1] + j * node_keys + c % fanout - 1].first = data[c * span].first;
+                }
+            }
+        }
+    }
+
+    template<typename K, typename V, size_t Order>
+    typename frozen_btree<K, V, Order>::const_iterator
+    frozen_btree<K, V, Order>::search(const key_type& k, bool upper) const
+    {
+        if( !_size )
+        {
+            return end();
+        }
+
+        btree_helper::compare<K, V> comp;
+        value_type val;
+        val.first = k;
+
+        size_t j = 0;
+        for(size_t l = 0; l + 1 < _nodes.size(); ++l)
+        {
+            // number of valid separators in node j
+            size_t keys = std::min<size_t>(fanout, _nodes[l+1] - j * fanout) - 1;
+            const value_type* sep = &_slots[_offset[l] + j * node_keys];
+
+            // the answer is either in the c-th subtree or the first pair of
+            // the (c+1)-th subtree, where c is the number of separators
+            // less than k (or not greater than k for upper bound)
+            size_t c = (upper ? std::upper_bound(sep, sep + keys, val, comp)
+                              : std::lower_bound(sep, sep + keys, val, comp)) - sep;
+            j = j * fanout + c;
+        }
+
+        const_iterator first = begin() + j * node_keys;
+        const_iterator last  = begin() + std::min<size_t>(_size, (j + 1) * node_keys);
+        return upper ? std::upper_bound(first, last, val, comp) : std::lower_bound(first, last, val, comp);
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    frozen_btree<K, V, Order> btree<K, V, Order, Aggregate, Encoding>::freeze()
+    {
+        return frozen_btree<K, V, Order>(begin(), _size);
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+#include <vector>
+#include <utility>
+
+#include "btree.h"
+
+namespace algo
+{
+    // Map of disjoint half-open key ranges [start, end) to values, on a btree
+    // keyed by the starts of the ranges. Ranges do not overlap, thus their
+    // ends ascend with their starts, and the range containing a key is the
+    // last one starting at or before it, found in one descent.
+    // Inserting a range replaces whatever it covers, then joins it with
+    // adjacent ranges of equal value.
+    template<typename K, typename V, size_t Order>
+    class interval_btree
+    {
+    public:
+        typedef interval_btree<K, V, Order> my_type;
+        typedef K                           key_type;
+
+        // map keys within [start, end) to v, empty ranges are ignored
+        void insert(const key_type& start, const key_type& end, const V& v);
+
+        // unmap keys within [start, end), ranges across the bounds are cut
+        void erase(const key_type& start, const key_type& end);
+
+        // search for the range containing k, copy its value to v, returns
+        // false if k is not mapped
+        bool find(const key_type& k, V& v);
+
+        // visit ranges overlapping [lo, hi) in ascending order,
+        // fn(start, end, value) is called for each of them
+        template<typename Function>
+        void for_each(const key_type& lo, const key_type& hi, Function fn);
+
+        // number of ranges
+        size_t size() const { return _tree.size(); }
+        bool   empty() const { return _tree.empty(); }
+
+    private:
+        // start of a range to its end and value
+        typedef btree<K, std::pair<K, V>, Order>  tree_type;
+        typedef typename tree_type::iterator      tree_iterator;
+
+        tree_type _tree;
+    };
+
+    template<typename K, typename V, size_t Order>
+    void interval_btree<K, V, Order>::insert(const key_type& start, const key_type& end, const V& v)
+    {
+        if( !(start < end) )
+        {
+            return;
+        }
+        erase(start, end);
+
+        // a range of equal value starting at end is absorbed
+        key_type last = end;
+        tree_iterator right = _tree.lower_bound(end);
+        if( right != _tree.end() && !(end < right->first) && right->second.second == v )
+        {
+            last = right->second.first;
+            _tree.erase(end);
+        }
+
+        // a range of equal value ending at start is extended
+        tree_iterator left = _tree.floor(start);
+        if( left != _tree.end() && !(left->second.first < start) && left->second.second == v )
+        {
+            left->second.first = last;
+            return;
+        }
+
+        _tree.insert(std::make_pair(start, std::make_pair(last, v)));
+    }
+
+    template<typename K, typename V, size_t Order>
+    void interval_btree<K, V, Order>::erase(const key_type& start, const key_type& end)
+    {
+        if( !(start < end) )
+        {
+            return;
+        }
+
+        // a range starting before start keeps its part on the left, and its
+        // part on the right of end if it covers both
+        tree_iterator it = _tree.floor(start);
+        if( it != _tree.end() && it->first < start && start < it->second.first )
+        {
+            std::pair<K, V> tail = it->second;
+            it->second.first = start;
+            if( end < tail.first )
+            {
+                _tree.insert(std::make_pair(end, tail));
+                return;
+            }
+        }
+
+        // ranges starting within [start, end) are dropped, the last of them
+        // may keep its part on the right of end
+        std::vector<key_type> inside;
+        std::pair<K, V> tail;
+        bool has_tail = false;
+        for(it = _tree.lower_bound(start); it != _tree.end() && it->first < end; ++it)
+        {
+            inside.push_back(it->first);
+            if( end < it->second.first )
+            {
+                tail = it->second;
+                has_tail = true;
+            }
+        }
+
+        for(size_t i = 0; i < inside.size(); ++i)
+        {
+            _tree.erase(inside[i]);
+        }
+        if( has_tail )
+        {
+            _tree.insert(std::make_pair(end, tail));
+        }
+    }
+
+    template<typename K, typename V, size_t Order>
+    bool interval_btree<K, V, Order>::find(const key_type& k, V& v)
+    {
+        tree_iterator it = _tree.floor(k);
+        if( it == _tree.end() || !(k < it->second.first) )
+        {
+            return false;
+        }
+        v = it->second.second;
+        return true;
+    }
+
+    template<typename K, typename V, size_t Order>
+    template<typename Function>
+    void interval_btree<K, V, Order>::for_each(const key_type& lo, const key_type& hi, Function fn)
+    {
+        if( !(lo < hi) )
+        {
+            return;
+        }
+
+        // the range containing lo if any, then the ranges starting before hi
+        tree_iterator it = _tree.floor(lo);
+        if( it == _tree.end() )
+        {
+            it = _tree.begin();
+        }
+        else if( !(lo < it->second.first) )
+        {
+            ++it;
+        }
+
+        for(; it != _tree.end() && it->first < hi; ++it)
+        {
+            fn(it->first, it->second.first, it->second.second);
+        }
+    }
+}
@@ -0,0 +1,190 @@
+#pragma once
+#include <vector>
+#include <type_traits>
+
+#include "frozen_btree.h"
+
+namespace algo
+{
+    // Immutable b-tree with frame-of-reference compressed leaves, for integer
+    // keys. A leaf stores its keys as offsets from its first key, all in the
+    // narrowest of 1, 2, 4 or 8 bytes that fits the largest offset, and its
+    // values apart from the keys. Leaves are located by a frozen_btree of
+    // their first keys. Within a leaf, the offsets less than the target are
+    // counted by a loop without branches, which compilers vectorize.
+    //  LeafKeys: number of pairs per leaf
+    template<typename K, typename V, size_t Order, size_t LeafKeys = 128>
+    class packed_btree
+    {
+    public:
+        typedef packed_btree<K, V, Order, LeafKeys> my_type;
+        typedef std::pair<K, V>                     value_type;
+        typedef K                                   key_type;
+
+        static_assert(std::is_integral<K>::value, "packed_btree needs integer keys");
+
+        // Pairs are decoded on the fly, thus dereferencing an iterator gives
+        // a copy of the pair.
+        class const_iterator
+        {
+        public:
+            class pointer
+            {
+            public:
+                pointer(const value_type& v): _v(v) {}
+                const value_type* operator->() const { return &_v; }
+            private:
+                value_type _v;
+            };
+
+            const_iterator(): _tree(nullptr), _n(0) {}
+
+            value_type operator* () const { return value_type(_tree->key_at(_n), _tree->_values[_n]); }
+            pointer    operator->() const { return pointer(**this); }
+
+            const_iterator& operator++() { ++_n; return *this; }
+
+            bool operator== (const const_iterator& another) const { return _n == another._n; }
+            bool operator!= (const const_iterator& another) const { return _n != another._n; }
+
+        private:
+            friend class packed_btree;
+
+            const_iterator(const my_type* tree, size_t n): _tree(tree), _n(n) {}
+
+            const my_type* _tree;
+            size_t         _n;
+        };
+        typedef const_iterator iterator;
+
+        packed_btree(): _size(0) {}
+
+        // build from count ordered, unique key-value pairs starting from first
+        template<typename InputIterator>
+        packed_btree(InputIterator first, size_t count);
+
+        size_t size() const  { return _size; }
+        bool   empty() const { return !_size; }
+
+        // approximate number of bytes used by keys and values
+        size_t memory() const
+        {
+            return _index.size() * sizeof(std::pair<K, size_t>) + _leaves.size() * sizeof(leaf)
+                 + _deltas.size() + _values.size() * sizeof(V);
+        }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const   { return const_iterator(this, _size); }
+
+        // Find the first pair whose key is not less than k
+        const_iterator lower_bound(const key_type& k) const { return const_iterator(this, search(k, false)); }
+
+        // Find the first pair whose key is greater than k
+        const_iterator upper_bound(const key_type& k) const { return const_iterator(this, search(k, true)); }
+
+        const_iterator find(const key_type& k) const
+        {
+            size_t n = search(k, false);
+            return n != _size && !(k < key_at(n)) ? const_iterator(this, n) : end();
+        }
+
+        // rebuild a mutable btree from the contents
+        btree<K, V, Order> thaw() const
+        {
+            btree<K, V, Order> tr;
+            tr.assign_sorted(begin(), _size);
+            return tr;
+        }
+
+    private:
+        typedef btree_helper::key_offsets<K>  codec;
+        typedef typename codec::offset_type   offset_type;
+
+        class leaf
+        {
+        public:
+            K             base;   // first key
+            size_t        pos;    // first byte of the offsets in _deltas
+            unsigned char width;  // bytes per offset
+        };
+
+        key_type key_at(size_t n) const;
+
+        // position of the first pair whose key is not less (greater if upper) than k
+        size_t search(const key_type& k, bool upper) const;
+
+        frozen_btree<K, size_t, Order> _index;  // first key of each leaf to the leaf
+        std::vector<leaf>              _leaves;
+        std::vector<unsigned char>     _deltas;
+        std::vector<V>                 _values;
+        size_t                         _size;
+    };
+
+    template<typename K, typename V, size_t Order, size_t LeafKeys>
+    template<typename InputIterator>
+    packed_btree<K, V, Order, LeafKeys>::packed_btree(InputIterator first, size_t count): _size(count)
+    {
+        std::vector<std::pair<K, size_t> > bases;
+        std::vector<K> keys;
+        _values.reserve(count);
+        for(size_t s = 0; s < count; s += LeafKeys)
+        {
+            size_t m = std::min<size_t>(LeafKeys, count - s);
+            keys.clear();
+            for(size_t i = 0; i < m; ++i, ++first)
+            {
+                value_type val = *first;
+                keys.push_back(val.first);
+                _values.push_back(val.second);
+            }
+
+            offset_type range = offset_type(keys.back()) - offset_type(keys.front());
+            leaf l;
+            l.base  = keys.front();
+            l.pos   = _deltas.size();
+            l.width = codec::width_of(range);
+
+            // offsets of every leaf start 8 bytes apart, aligned for their width
+            _deltas.resize(l.pos + (m * l.width + 7) / 8 * 8);
+            for(size_t i = 0; i < m; ++i)
+            {
+                codec::store(&_deltas[l.pos + i * l.width], l.width, offset_type(keys[i]) - offset_type(l.base));
+            }
+
+            bases.push_back(std::make_pair(l.base, _leaves.size()));
+            _leaves.push_back(l);
+        }
+
+        _index = frozen_btree<K, size_t, Order>(bases.begin(), bases.size());
+    }
+
+    template<typename K, typename V, size_t Order, size_t LeafKeys>
+    typename packed_btree<K, V, Order, LeafKeys>::key_type packed_btree<K, V, Order, LeafKeys>::key_at(size_t n) const
+    {
+        const leaf& l = _leaves[n / LeafKeys];
+        return K(offset_type(l.base) + codec::load(&_deltas[l.pos + n % LeafKeys * l.width], l.width));
+    }
+
+    template<typename K, typename V, size_t Order, size_t LeafKeys>
+    size_t packed_btree<K, V, Order, LeafKeys>::search(const key_type& k, bool upper) const
+    {
+        // the last leaf whose first key is not greater than k
+        typename frozen_btree<K, size_t, Order>::const_iterator it = _index.upper_bound(k);
+        if( it == _index.begin() )
+        {
+            return 0;
+        }
+        --it;
+
+        size_t n = it->second;
+        const leaf& l = _leaves[n];
+        size_t m = std::min<size_t>(LeafKeys, _size - n * LeafKeys);
+        return n * LeafKeys + codec::count(&_deltas[l.pos], m, l.width, offset_type(k) - offset_type(l.base), upper);
+    }
+
+    template<typename K, typename V, size_t Order, typename Aggregate, typename Encoding>
+    packed_btree<K, V, Order, 128> btree<K, V, Order, Aggregate, Encoding>::pack()
+    {
+        return packed_btree<K, V, Order, 128>(begin(), _size);
+    }
+}
@@ -0,0 +1,533 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#include "btree.h"
+
+namespace algo
+{
+    // Ordered map for concurrent use, made of independent b-trees which
+    // partition the key space into consecutive ranges. Every shard has its
+    // own reader-writer lock, so operations on different shards never wait
+    // for each other.
+    // Boundaries of shards follow the keys: a shard holding more than twice
+    // the average number of keys evens out with its lighter neighbour while
+    // the others keep running. Keys move over a batch at a time, so the two
+    // shards are only locked for short whiles. Shards start empty except the
+    // first one, the keys spread to the right as the map grows.
+    template<typename K, typename V, size_t Order>
+    class sharded_btree
+    {
+    public:
+        typedef sharded_btree<K, V, Order>  my_type;
+        typedef btree<K, V, Order>          shard_type;
+        typedef typename shard_type::value_type value_type;
+        typedef typename shard_type::key_type   key_type;
+
+        enum
+        {
+            min_rebalance = 1024, // shards smaller than this are never rebalanced
+            move_batch    = 256,  // keys moved between shards per lock
+            scan_batch    = 256,  // pairs copied out of a shard per lock
+            stripes       = 64,   // counters of readers routing with a table
+        };
+
+        explicit sharded_btree(size_t shards = 16);
+        ~sharded_btree() { delete _table.load(); }
+
+        // number of shards
+        size_t shards() const { return _shards.size(); }
+
+        // number of keys in the n-th shard
+        size_t shard_size(size_t n) const { return _shards[n]->count; }
+
+        // number of keys in the map
+        size_t size() const { return _size; }
+
+        // insert a key-value pair, overwrite existing value
+        void insert(const value_type& val);
+
+        // erase a key-value pair
+        void erase(const key_type& k);
+
+        // search for key k, copy its value to v, returns false if it is not found
+        bool find(const key_type& k, V& v);
+
+        // Visit all key-value pairs in ascending order. fn is called on
+        // copies of the pairs with no lock held, so it may update the map.
+        // Pairs written during the visit may be visited or not.
+        template<typename Function>
+        void for_each(Function fn)
+        {
+            scan(nullptr, nullptr, fn);
+        }
+
+        // visit key-value pairs within key range [lo, hi) in ascending order,
+        // as for_each above
+        template<typename Function>
+        void for_each(const key_type& lo, const key_type& hi, Function fn)
+        {
+            scan(&lo, &hi, fn);
+        }
+
+    private:
+        sharded_btree(const my_type&);
+        my_type& operator= (const my_type&);
+
+        // A shard owns keys within [lo, hi), unbounded on the sides without
+        // has_lo or has_hi. Shards on the right of the last active one own no key.
+        class shard
+        {
+        public:
+            shard(): active(false), has_lo(false), has_hi(false), count(0) {}
+
+            bool covers(const key_type& k) const
+            {
+                return active && (!has_lo || !(k < lo)) && (!has_hi || k < hi);
+            }
+
+            btree_helper::rw_lock lock;
+            shard_type            tree;
+            bool                  active;
+            bool                  has_lo, has_hi;
+            key_type              lo, hi;  // guarded by lock
+            std::atomic<size_t>   count;   // number of keys, written under lock
+        };
+
+        // Routing table, immutable once published. shard n owns keys within
+        // [bounds[n-1], bounds[n]), n <= bounds.size().
+        class table
+        {
+        public:
+            size_t locate(const key_type& k) const
+            {
+                return std::upper_bound(bounds.begin(), bounds.end(), k) - bounds.begin();
+            }
+
+            std::vector<key_type> bounds;
+        };
+
+        // Number of readers routing with a table. Threads count on the
+        // stripe of their id, a cache line each, so readers rarely share one.
+        class stripe
+        {
+        public:
+            stripe(): readers(0) {}
+
+            std::atomic<size_t> readers;
+            char                pad[64 - sizeof(std::atomic<size_t>)];
+        };
+
+        // index of the shard owning k in the current table
+        size_t route(const key_type& k);
+
+        // Publishes a routing table and frees the one it replaces, once
+        // every stripe was seen at zero: readers which loaded the old table
+        // are done with it by then, later ones load the new table.
+        void publish(table* next);
+
+        // Locks the shard owning k, exclusively if write. Shards moved by a
+        // concurrent rebalance are located again.
+        size_t acquire(const key_type& k, bool write);
+
+        // Evens out shard n with its lighter neighbour if n is overloaded,
+        // then goes on with the neighbour, which may be overloaded now.
+        // Repartitions all shards if no neighbour is light enough.
+        void rebalance(size_t n);
+
+        // Evens out shard n with neighbour m, returns false if n is not
+        // overloaded or no neighbour is light enough
+        bool even_out(size_t n, size_t& m);
+
+        // Spreads all keys evenly over the shards, shifting keys between
+        // neighbours from left to right, then back from right to left
+        void repartition();
+
+        // Moves up to count keys from shard l to shard l+1 if right, from
+        // l+1 to l otherwise, move_batch keys per lock of the two shards.
+        // The giving shard keeps a key at least. Returns the keys moved.
+        size_t shift(size_t l, size_t count, bool right);
+
+        bool overloaded(size_t count) const
+        {
+            return count > min_rebalance && count > 2 * _size / _shards.size();
+        }
+
+        template<typename Function>
+        void scan(const key_type* lo, const key_type* hi, Function& fn);
+
+    private:
+        std::vector<std::unique_ptr<shard> > _shards;
+        std::atomic<const table*>            _table;
+        std::atomic<size_t>                  _size;
+        stripe                               _routing[stripes];
+        std::mutex                           _rebalance; // rebalances are serialized
+    };
+
+    template<typename K, typename V, size_t Order>
+    sharded_btree<K, V, Order>::sharded_btree(size_t shards): _table(new table()), _size(0)
+    {
+        if( !shards )
+        {
+            shards = 1;
+        }
+
+        for(size_t n = 0; n < shards; ++n)
+        {
+            _shards.push_back(std::unique_ptr<shard>(new shard()));
+        }
+        _shards[0]->active = true;
+    }
+
+    template<typename K, typename V, size_t Order>
+    size_t sharded_btree<K, V, Order>::route(const key_type& k)
+    {
+        stripe& s = _routing[std::hash<std::thread::id>()(std::this_thread::get_id()) % stripes];
+        ++s.readers;
+        size_t n = _table.load()->locate(k);
+        --s.readers;
+        return n;
+    }
+
+    template<typename K, typename V, size_t Order>
+    void sharded_btree<K, V, Order>::publish(table* next)
+    {
+        const table* old = _table.exchange(next);
+        for(size_t n = 0; n < stripes; ++n)
+        {
+            while( _routing[n].readers.load() )
+            {
+                std::this_thread::yield();
+            }
+        }
+        delete old;
+    }
+
+    template<typename K, typename V, size_t Order>
+    size_t sharded_btree<K, V, Order>::acquire(const key_type& k, bool write)
+    {
+        for(;;)
+        {
+            size_t n = route(k);
+            shard& s = *_shards[n];
+            if( write )
+            {
+                s.lock.lock();
+            }
+            else
+            {
+                s.lock.lock_shared();
+            }
+
+            // a rebalance publishes the new table before it releases the
+            // shards, thus the next try routes with the new table
+            if( s.covers(k) )
+            {
+                return n;
+            }
+
+            if( write )
+            {
+                s.lock.unlock();
+            }
+            else
+            {
+                s.lock.unlock_shared();
+            }
+        }
+    }
+
+    template<typename K, typename V, size_t Order>
+    void sharded_btree<K, V, Order>::insert(const value_type& val)
+    {
+        size_t n = acquire(val.first, true);
+        shard& s = *_shards[n];
+        s.tree.insert(val);
+
+        size_t count = s.tree.size();
+        _size += count - s.count;
+        s.count = count;
+        s.lock.unlock();
+
+        if( overloaded(count) )
+        {
+            rebalance(n);
+        }
+    }
+
+    template<typename K, typename V, size_t Order>
+    void sharded_btree<K, V, Order>::erase(const key_type& k)
+    {
+        size_t n = acquire(k, true);
+        shard& s = *_shards[n];
+        s.tree.erase(k);
+
+        size_t count = s.tree.size();
+        _size -= s.count - count;
+        s.count = count;
+        s.lock.unlock();
+    }
+
+    template<typename K, typename V, size_t Order>
+    bool sharded_btree<K, V, Order>::find(const key_type& k, V& v)
+    {
+        shard& s = *_shards[acquire(k, false)];
+        typename shard_type::iterator it = s.tree.find(k);
+        bool found = it != s.tree.end();
+        if( found )
+        {
+            v = it->second;
+        }
+        s.lock.unlock_shared();
+        return found;
+    }
+
+    template<typename K, typename V, size_t Order>
+    void sharded_btree<K, V, Order>::rebalance(size_t n)
+    {
+        std::unique_lock<std::mutex> guard(_rebalance, std::try_to_lock);
+        if( !guard.owns_lock() )
+        {
+            return; // another thread is rebalancing
+        }
+
+        bool moved = false;
+        for(size_t m = n; even_out(n, m); n = m)
+        {
+            moved = true;
+        }
+
+        if( !moved && overloaded(_shards[n]->count) )
+        {
+            repartition();
+        }
+    }
+
+    template<typename K, typename V, size_t Order>
+    bool sharded_btree<K, V, Order>::even_out(size_t n, size_t& m)
+    {
+        size_t count = _shards[n]->count;
+        if( !overloaded(count) )
+        {
+            return false;
+        }
+
+        // pick the lighter neighbour, worth the move only if it holds less
+        // than 3/4 of the keys of shard n, then at least 1/8 of the keys of
+        // shard n move. The neighbour on the right of the last active shard
+        // is an empty one.
+        m = n;
+        if( n > 0 )
+        {
+            m = n - 1;
+        }
+        if( n + 1 < _shards.size() && (m == n || _shards[n+1]->count < _shards[m]->count) )
+        {
+            m = n + 1;
+        }
+        size_t light = _shards[m]->count;
+        if( m == n || 4 * light >= 3 * count )
+        {
+            return false;
+        }
+
+        size_t l = std::min(n, m);
+        return shift(l, (count - light) / 2, l == n) != 0;
+    }
+
+    template<typename K, typename V, size_t Order>
+    void sharded_btree<K, V, Order>::repartition()
+    {
+        // every active shard takes at least one key, the keys on the left
+        // of boundary n make (n + 1) / active of the map once spread
+        size_t shards = _shards.size(), size = _size;
+        size_t active = std::min(shards, std::max<size_t>(size, 1));
+
+        // surpluses go right, shard n holds the keys shifted from the left
+        size_t prefix = 0;
+        for(size_t n = 0; n + 1 < active; ++n)
+        {
+            prefix += _shards[n]->count;
+            size_t goal = size * (n + 1) / active;
+            if( prefix > goal )
+            {
+                prefix -= shift(n, prefix - goal, true);
+            }
+        }
+
+        // shortfalls come back from the right, shard n+1 holds the keys of
+        // the shortfall as the boundaries on its right are settled
+        for(size_t n = active - 1; n-- > 0; )
+        {
+            prefix = 0;
+            for(size_t i = 0; i <= n; ++i)
+            {
+                prefix += _shards[i]->count;
+            }
+            size_t goal = size * (n + 1) / active;
+            if( prefix < goal )
+            {
+                shift(n, goal - prefix, false);
+            }
+        }
+    }
+
+    template<typename K, typename V, size_t Order>
+    size_t sharded_btree<K, V, Order>::shift(size_t l, size_t count, bool right)
+    {
+        size_t r = l + 1, moved = 0;
+        shard& ls = *_shards[l];
+        shard& rs = *_shards[r];
+        shard& from = right ? ls : rs;
+        shard& to   = right ? rs : ls;
+
+        std::vector<value_type> pairs;
+        while( moved < count )
+        {
+            ls.lock.lock();
+            rs.lock.lock();
+
+            size_t spare = from.count > 1 ? from.count - 1 : 0;
+            size_t batch = std::min(count - moved, std::min<size_t>(spare, move_batch));
+            if( !batch )
+            {
+                rs.lock.unlock();
+                ls.lock.unlock();
+                break;
+            }
+
+            // the greatest keys go right, the smallest ones go left
+            pairs.clear();
+            if( right )
+            {
+                for(typename shard_type::reverse_iterator it = from.tree.rbegin(); pairs.size() < batch; ++it)
+                {
+                    pairs.push_back(*it);
+                }
+            }
+            else
+            {
+                for(typename shard_type::iterator it = from.tree.begin(); pairs.size() < batch; ++it)
+                {
+                    pairs.push_back(*it);
+                }
+            }
+            for(size_t i = 0; i < pairs.size(); ++i)
+            {
+                from.tree.erase(pairs[i].first);
+                to.tree.insert(pairs[i]);
+            }
+            from.count = from.tree.size();
+            to.count   = to.tree.size();
+
+            // the right shard starts at its smallest key, the table is only
+            // replaced by rebalances
+            const key_type& bound = right ? pairs.back().first : rs.tree.begin()->first;
+            table* next = new table(*_table.load());
+            if( next->bounds.size() == l )
+            {
+                next->bounds.push_back(bound);
+            }
+            else
+            {
+                next->bounds[l] = bound;
+            }
+
+            ls.has_hi = true;
+            ls.hi     = bound;
+            rs.active = true;
+            rs.has_lo = true;
+            rs.lo     = bound;
+            rs.has_hi = r < next->bounds.size();
+            if( rs.has_hi )
+            {
+                rs.hi = next->bounds[r];
+            }
+
+            publish(next);
+            rs.lock.unlock();
+            ls.lock.unlock();
+            moved += batch;
+        }
+        return moved;
+    }
+
+    template<typename K, typename V, size_t Order>
+    template<typename Function>
+    void sharded_btree<K, V, Order>::scan(const key_type* lo, const key_type* hi, Function& fn)
+    {
+        // Pairs are copied out of a shard a batch at a time, fn is called
+        // once the shard is released. The scan goes on from the last key
+        // copied, or from the lower bound of the next shard, routed again
+        // as boundaries may have moved meanwhile.
+        std::vector<value_type> pairs;
+        key_type from;
+        bool     bounded = lo != nullptr, after = false;
+        if( lo )
+        {
+            from = *lo;
+        }
+
+        for(;;)
+        {
+            size_t n = 0;
+            if( bounded )
+            {
+                n = acquire(from, false);
+            }
+            else
+            {
+                _shards[0]->lock.lock_shared(); // the first shard owns the smallest keys
+            }
+
+            shard& s = *_shards[n];
+            typename shard_type::iterator it = bounded ? s.tree.lower_bound(from) : s.tree.begin();
+            if( after && it != s.tree.end() && !(from < it->first) )
+            {
+                ++it;
+            }
+
+            bool done = false;
+            pairs.clear();
+            for(; it != s.tree.end() && pairs.size() < scan_batch; ++it)
+            {
+                if( hi && !(it->first < *hi) )
+                {
+                    done = true;
+                    break;
+                }
+                pairs.push_back(*it);
+            }
+
+            if( !pairs.empty() )
+            {
+                from  = pairs.back().first;
+                after = true;
+            }
+            else if( !done && s.has_hi && (!hi || s.hi < *hi) )
+            {
+                from  = s.hi;
+                after = false;
+            }
+            else
+            {
+                done = true;
+            }
+            bounded = true;
+            s.lock.unlock_shared();
+
+            for(size_t i = 0; i < pairs.size(); ++i)
+            {
+                fn(pairs[i]);
+            }
+            if( done )
+            {
+                return;
+            }
+        }
+    }
+}